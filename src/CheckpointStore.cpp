@@ -0,0 +1,146 @@
+#include "CheckpointStore.hpp"
+
+#include <algorithm>
+
+unsigned int CheckpointStore::count() const { return m_checkpoints.size(); }
+
+PersistentCheckpoint* CheckpointStore::at(unsigned int index) const {
+	return m_checkpoints[index];
+}
+
+unsigned int CheckpointStore::indexOf(PersistentCheckpoint* checkpoint) {
+	if (!m_indicesValid) {
+		m_indices.clear();
+		for (unsigned int i = 0; i < m_checkpoints.size(); i++)
+			m_indices[m_checkpoints[i]] = i;
+		m_indicesValid = true;
+	}
+
+	auto index = m_indices.find(checkpoint);
+	if (index == m_indices.end())
+		return count();
+
+	return index->second;
+}
+
+bool CheckpointStore::contains(PersistentCheckpoint* checkpoint) {
+	return indexOf(checkpoint) < count();
+}
+
+CheckpointStore::Iterator CheckpointStore::begin() const {
+	return m_checkpoints.begin();
+}
+
+CheckpointStore::Iterator CheckpointStore::end() const {
+	return m_checkpoints.end();
+}
+
+// Reordered layers fall back to the first checkpoint that's further, which is
+// where the binary search would end up if they were sorted
+unsigned int CheckpointStore::getSortedIndex(
+	PersistentCheckpoint* checkpoint, bool platformer
+) const {
+	const std::vector<double>& keys = platformer ? m_times : m_percents;
+	double key = platformer ? checkpoint->m_time : checkpoint->m_percent;
+
+	if ((platformer ? m_timeInversions : m_percentInversions) == 0)
+		return std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+
+	return std::find_if(
+				 keys.begin(), keys.end(),
+				 [key](double other) { return other > key; }
+			 ) -
+			 keys.begin();
+}
+
+void CheckpointStore::insert(
+	unsigned int index, PersistentCheckpoint* checkpoint
+) {
+	if (index > 0)
+		countInversions(index - 1, -1);
+
+	m_checkpoints.insert(m_checkpoints.begin() + index, checkpoint);
+	m_times.insert(m_times.begin() + index, checkpoint->m_time);
+	m_percents.insert(m_percents.begin() + index, checkpoint->m_percent);
+
+	if (index > 0)
+		countInversions(index - 1, 1);
+	countInversions(index, 1);
+
+	if (index + 1 == m_checkpoints.size())
+		m_indices[checkpoint] = index;
+	else
+		m_indicesValid = false;
+}
+
+void CheckpointStore::add(PersistentCheckpoint* checkpoint) {
+	insert(count(), checkpoint);
+}
+
+void CheckpointStore::remove(unsigned int index) {
+	if (index > 0)
+		countInversions(index - 1, -1);
+	countInversions(index, -1);
+
+	m_indices.erase(m_checkpoints[index]);
+	m_checkpoints.erase(m_checkpoints.begin() + index);
+	m_times.erase(m_times.begin() + index);
+	m_percents.erase(m_percents.begin() + index);
+
+	if (index > 0)
+		countInversions(index - 1, 1);
+
+	if (index < m_checkpoints.size())
+		m_indicesValid = false;
+}
+
+void CheckpointStore::swap(unsigned int left, unsigned int right) {
+	if (left == right)
+		return;
+	if (left > right)
+		std::swap(left, right);
+
+	// Both neighbour pairs of each checkpoint, the middle one is shared when
+	// they're next to each other
+	std::vector<unsigned int> pairs = {left, right};
+	if (left > 0)
+		pairs.push_back(left - 1);
+	if (right - 1 != left)
+		pairs.push_back(right - 1);
+
+	for (unsigned int pair : pairs)
+		countInversions(pair, -1);
+
+	std::swap(m_checkpoints[left], m_checkpoints[right]);
+	std::swap(m_times[left], m_times[right]);
+	std::swap(m_percents[left], m_percents[right]);
+
+	for (unsigned int pair : pairs)
+		countInversions(pair, 1);
+
+	if (m_indicesValid) {
+		m_indices[m_checkpoints[left]] = left;
+		m_indices[m_checkpoints[right]] = right;
+	}
+}
+
+void CheckpointStore::clear() {
+	m_checkpoints.clear();
+	m_times.clear();
+	m_percents.clear();
+	m_timeInversions = 0;
+	m_percentInversions = 0;
+	m_indices.clear();
+	m_indicesValid = true;
+}
+
+// Counts the pair of the checkpoint at the index and the one after it
+void CheckpointStore::countInversions(unsigned int index, int change) {
+	if (index + 1 >= m_checkpoints.size())
+		return;
+
+	if (m_times[index] > m_times[index + 1])
+		m_timeInversions += change;
+	if (m_percents[index] > m_percents[index + 1])
+		m_percentInversions += change;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "PersistentCheckpoint.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+// The checkpoints of the loaded layer in their order. Their times and percents
+// are kept in arrays next to them, finding where a new checkpoint goes is a
+// binary search over them as long as the user hasn't moved a checkpoint out of
+// order
+class CheckpointStore {
+public:
+	using Iterator = std::vector<Ref<PersistentCheckpoint>>::const_iterator;
+
+	unsigned int count() const;
+	PersistentCheckpoint* at(unsigned int index) const;
+	// Returns count() if the checkpoint isn't in the store
+	unsigned int indexOf(PersistentCheckpoint* checkpoint);
+	bool contains(PersistentCheckpoint* checkpoint);
+	Iterator begin() const;
+	Iterator end() const;
+
+	// Index after every checkpoint that isn't further than this one, by time
+	// in platformer levels
+	unsigned int
+	getSortedIndex(PersistentCheckpoint* checkpoint, bool platformer) const;
+	void insert(unsigned int index, PersistentCheckpoint* checkpoint);
+	void add(PersistentCheckpoint* checkpoint);
+	void remove(unsigned int index);
+	void swap(unsigned int left, unsigned int right);
+	void clear();
+
+private:
+	std::vector<Ref<PersistentCheckpoint>> m_checkpoints;
+	std::vector<double> m_times;
+	std::vector<double> m_percents;
+	// Neighbours where the first one is further, a layer without any is sorted
+	unsigned int m_timeInversions = 0;
+	unsigned int m_percentInversions = 0;
+	// Rebuilt when it's next needed after checkpoints moved, loading a layer
+	// inserts every checkpoint before anything is looked up
+	std::unordered_map<PersistentCheckpoint*, unsigned int> m_indices;
+	bool m_indicesValid = true;
+
+	void countInversions(unsigned int index, int change);
+};
@@ -1,4 +1,6 @@
 #include "PauseLayer.hpp"
+#include "../Save/SaveCatalog.hpp"
+#include "../Save/SavePath.hpp"
 #include "../UI/CheckpointManager.hpp"
 #include "PlayLayer.hpp"
 
@@ -22,30 +24,34 @@ void ModPauseLayer::customSetup() {
 				CheckpointManager::create()->show();
 			else {
 				ModPlayLayer* modPlayLayer = static_cast<ModPlayLayer*>(playLayer);
-				std::filesystem::path path = modPlayLayer->getSavePath();
-				if (std::filesystem::exists(path))
+				modPlayLayer->loadSaveContainer();
+				if (modPlayLayer->m_fields->m_saveContainer.getLayerCount() != 0)
 					geode::createQuickPopup(
 						"Persistent Checkpoints",
 						"Open in practice mode to manage checkpoints.", "Ok",
-						"Delete Saved", [path, modPlayLayer](auto, bool confirmed) {
+						"Delete Saved", [modPlayLayer](auto, bool confirmed) {
 							if (confirmed)
 								geode::createQuickPopup(
 									"Delete All",
 									"Delete all saved checkpoints for this level?\n"
 									"This action cannot be undone.",
 									"Cancel", "Delete",
-									[path, modPlayLayer](auto, bool confirmed) {
-										if (confirmed)
-											std::filesystem::remove(path);
-										while (true) {
-											modPlayLayer->m_fields->m_activeSaveLayer++;
-											std::filesystem::path layerPath =
-												modPlayLayer->getSavePath();
-											if (std::filesystem::exists(layerPath))
-												std::filesystem::remove(layerPath);
-											else
-												break;
+									[modPlayLayer](auto, bool confirmed) {
+										if (!confirmed)
+											return;
+
+										// Both detail modes have their own saves
+										for (bool lowDetailMode : {false, true}) {
+											std::filesystem::path containerPath =
+												getLevelSaveBasePath(
+													modPlayLayer->m_level, lowDetailMode
+												);
+											containerPath.concat(".pcpc");
+											SaveCatalog::get()->deleteLevel(containerPath);
 										}
+										modPlayLayer->m_fields->m_saveContainer.clear();
+										modPlayLayer->m_fields->m_blockStore.clear();
+										modPlayLayer->m_fields->m_statsLog.clear();
 										modPlayLayer->m_fields->m_activeSaveLayer = 0;
 									}
 								);
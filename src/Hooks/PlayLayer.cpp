@@ -1,6 +1,14 @@
 #include "PlayLayer.hpp"
+#include "../Save/SaveCatalog.hpp"
+#include "../Save/SaveWriter.hpp"
 #include "UILayer.hpp"
 
+#include <Geode/loader/Dispatch.hpp>
+
+using LayerSizeFilter = DispatchFilter<uint64_t*, uint64_t*, uint64_t*>;
+using CheckpointSizeFilter =
+	DispatchFilter<unsigned int, uint64_t*, uint64_t*>;
+
 $execute {
 	new EventListener<SettingChangedFilterV3>(
 		+[](std::shared_ptr<SettingV3> setting) {
@@ -12,6 +20,55 @@ $execute {
 		},
 		SettingChangedFilterV3(Mod::get(), "progressbar-checkpoint-opacity")
 	);
+	new EventListener<SettingChangedFilterV3>(
+		+[](std::shared_ptr<SettingV3> setting) {
+			ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+			SaveCatalog::get()->enforceQuota(
+				playLayer != nullptr ? playLayer->getContainerPath()
+											: std::filesystem::path()
+			);
+		},
+		SettingChangedFilterV3(Mod::get(), "save-quota")
+	);
+
+	new EventListener<LayerSizeFilter>(
+		+[](uint64_t* storedSize, uint64_t* rawSize, uint64_t* memorySize) {
+			ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+			SaveLayerSize size;
+			if (playLayer != nullptr && playLayer->m_fields->m_hasSetUpCheckpoints)
+				size = playLayer->getSaveLayerSize();
+
+			*storedSize = size.m_storedSize;
+			*rawSize = size.m_rawSize;
+			*memorySize = size.m_memorySize;
+			return ListenerResult::Stop;
+		},
+		LayerSizeFilter("get-layer-size"_spr)
+	);
+	new EventListener<CheckpointSizeFilter>(
+		+[](unsigned int index, uint64_t* encodedSections,
+			 uint64_t* memorySections) {
+			ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+			std::pair<CheckpointSize, CheckpointSize> size;
+			if (playLayer != nullptr &&
+				 playLayer->m_fields->m_hasSetUpCheckpoints &&
+				 index < playLayer->m_fields->m_persistentCheckpoints.count())
+				size = playLayer->measureCheckpoint(
+					playLayer->m_fields->m_persistentCheckpoints.at(index)
+				);
+
+			std::copy(
+				size.first.m_sections.begin(), size.first.m_sections.end(),
+				encodedSections
+			);
+			std::copy(
+				size.second.m_sections.begin(), size.second.m_sections.end(),
+				memorySections
+			);
+			return ListenerResult::Stop;
+		},
+		CheckpointSizeFilter("get-checkpoint-size"_spr)
+	);
 }
 
 bool ModPlayLayer::init(
@@ -20,12 +77,13 @@ bool ModPlayLayer::init(
 	if (!PlayLayer::init(level, useReplay, dontCreateObjects))
 		return false;
 
-	if (m_fields->m_persistentCheckpointArray != nullptr && m_isPracticeMode &&
+	if (m_fields->m_hasSetUpCheckpoints && m_isPracticeMode &&
 		 !m_fields->m_hasAttemptedToLoadCheckpoints) {
 		m_fields->m_hasAttemptedToLoadCheckpoints = true;
 
 		updateSaveLayerCount();
 		deserializeCheckpoints();
+		SaveCatalog::get()->markUsed(getContainerPath());
 
 		updateModUI();
 	}
@@ -36,8 +94,8 @@ bool ModPlayLayer::init(
 void ModPlayLayer::setupHasCompleted() {
 	PlayLayer::setupHasCompleted();
 
-	if (m_fields->m_persistentCheckpointArray == nullptr) {
-		m_fields->m_persistentCheckpointArray = CCArray::create();
+	if (!m_fields->m_hasSetUpCheckpoints) {
+		m_fields->m_hasSetUpCheckpoints = true;
 
 		m_fields->m_persistentCheckpointBatchNode =
 			// @geode-ignore(unknown-resource)
@@ -76,6 +134,9 @@ void ModPlayLayer::setupHasCompleted() {
 
 void ModPlayLayer::destructor() {
 	unloadPersistentCheckpoints();
+	SaveWriter::get()->flush();
+	SaveCatalog::get()->enforceQuota(getContainerPath());
+	SaveBackup::get()->snapshotIfDue();
 	PlayLayer::~PlayLayer();
 }
 
@@ -92,6 +153,8 @@ void ModPlayLayer::processCreateObjectsFromSetup() {
 }
 
 void ModPlayLayer::resetLevel() {
+	m_fields->m_statsCheckpoint = nullptr;
+
 	PersistentCheckpoint* checkpoint = nullptr;
 	if (m_isPracticeMode) {
 		unsigned int loadIndex = 0;
@@ -101,28 +164,30 @@ void ModPlayLayer::resetLevel() {
 			loadIndex = m_fields->m_activeCheckpoint;
 
 		if (loadIndex != 0) {
-			checkpoint = reinterpret_cast<PersistentCheckpoint*>(
-				m_fields->m_persistentCheckpointArray->objectAtIndex(loadIndex - 1)
-			);
-			m_checkpointArray->addObject(checkpoint->m_checkpoint);
+			checkpoint = m_fields->m_persistentCheckpoints.at(loadIndex - 1);
+			if (decodePersistentCheckpoint(checkpoint)) {
+				m_checkpointArray->addObject(checkpoint->m_checkpoint);
+
+				checkpoint->m_lastRestored = ++m_fields->m_restoreCount;
+				enforceMemoryBudget();
+			} else
+				checkpoint = nullptr;
 		}
 	}
 
+	m_fields->m_restoringCheckpoint = checkpoint;
 	PlayLayer::resetLevel();
+	m_fields->m_restoringCheckpoint = nullptr;
 
 	if (checkpoint != nullptr)
 		m_checkpointArray->removeObject(checkpoint->m_checkpoint);
 }
 
 void ModPlayLayer::loadFromCheckpoint(CheckpointObject* checkpoint) {
-	PersistentCheckpoint* persistentCheckpoint = nullptr;
-	for (PersistentCheckpoint* perCheckpoint : CCArrayExt<PersistentCheckpoint*>(
-			  m_fields->m_persistentCheckpointArray
-		  ))
-		if (perCheckpoint->m_checkpoint == checkpoint) {
-			persistentCheckpoint = perCheckpoint;
-			break;
-		}
+	PersistentCheckpoint* persistentCheckpoint = m_fields->m_restoringCheckpoint;
+	if (persistentCheckpoint != nullptr &&
+		 persistentCheckpoint->m_checkpoint != checkpoint)
+		persistentCheckpoint = nullptr;
 
 	if (persistentCheckpoint != nullptr) {
 		m_timePlayed = persistentCheckpoint->m_time;
@@ -138,13 +203,18 @@ void ModPlayLayer::loadFromCheckpoint(CheckpointObject* checkpoint) {
 			persistentCheckpoint->m_persistentItemCountMap;
 		m_effectManager->m_persistentTimerItemSet =
 			persistentCheckpoint->m_persistentTimerItemSet;
+
+		m_fields->m_statsCheckpoint = persistentCheckpoint;
+		getStatsLog().recordAttempt(
+			m_fields->m_activeSaveLayer, persistentCheckpoint->m_id
+		);
 	}
 }
 
 void ModPlayLayer::togglePracticeMode(bool enabled) {
 	PlayLayer::togglePracticeMode(enabled);
 
-	if (m_fields->m_persistentCheckpointArray == nullptr)
+	if (!m_fields->m_hasSetUpCheckpoints)
 		return;
 
 	m_fields->m_activeSaveLayer = 0;
@@ -158,6 +228,23 @@ void ModPlayLayer::togglePracticeMode(bool enabled) {
 	updateModUI();
 }
 
+// Only counts deaths that end the attempt, noclip calls this without killing
+// the player
+void ModPlayLayer::destroyPlayer(PlayerObject* player, GameObject* object) {
+	bool playerDied = m_playerDied;
+
+	PlayLayer::destroyPlayer(player, object);
+
+	if (playerDied || !m_playerDied || m_fields->m_statsCheckpoint == nullptr)
+		return;
+
+	getStatsLog().recordDeath(
+		m_fields->m_activeSaveLayer, m_fields->m_statsCheckpoint->m_id,
+		getCurrentPercent()
+	);
+	m_fields->m_statsCheckpoint = nullptr;
+}
+
 void ModPlayLayer::storeCheckpoint(CheckpointObject* p0) {
 	PlayLayer::storeCheckpoint(p0);
 
@@ -249,9 +336,7 @@ void ModPlayLayer::updateModUI() {
 
 	unsigned int currentCheckpoint = 0;
 	float barWidth = m_progressBar->getContentWidth() - 4;
-	for (PersistentCheckpoint* checkpoint : CCArrayExt<PersistentCheckpoint*>(
-			  m_fields->m_persistentCheckpointArray
-		  )) {
+	for (PersistentCheckpoint* checkpoint : m_fields->m_persistentCheckpoints) {
 		GameObject* physicalObject =
 			checkpoint->m_checkpoint->m_physicalCheckpointObject;
 		CCSpriteFrame* frame = physicalObject->displayFrame();
@@ -1,9 +1,19 @@
 #pragma once
+#include "../CheckpointStore.hpp"
 #include "../PersistentCheckpoint.hpp"
+#include "../Save/BlockStore.hpp"
+#include "../Save/LevelFingerprint.hpp"
+#include "../Save/MappedFile.hpp"
+#include "../Save/SaveBackup.hpp"
+#include "../Save/SaveContainer.hpp"
+#include "../Save/SaveJournal.hpp"
+#include "../Save/StatsLog.hpp"
 #include "sabe.persistenceapi/include/util/Stream.hpp"
 
 #include <Geode/modify/PlayLayer.hpp>
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <optional>
 #include <sabe.persistenceapi/include/PersistenceAPI.hpp>
 #include <variant>
@@ -38,8 +48,6 @@ using namespace keybinds;
 #define PLATFORM 5
 #endif
 
-const std::hash<std::string> c_stringHasher;
-
 enum LoadError : char {
 	None,
 	Crash,
@@ -49,21 +57,89 @@ enum LoadError : char {
 	LevelVersionMismatch,
 };
 
+struct SaveHeader {
+	unsigned int m_version;
+	char m_platform;
+	LevelHash m_levelHash;
+	// Level version for online levels, level string fingerprint for editor
+	// levels
+	uint64_t m_levelIdentifier;
+};
+
+// Save changes made while a batch is open, they're written together when it's
+// committed
+struct SaveBatch {
+	std::vector<char> m_records;
+	bool m_orderChanged = false;
+	bool m_layerInfoChanged = false;
+	bool m_rewrite = false;
+	// Their blocks are released once the removal is written
+	std::vector<Ref<PersistentCheckpoint>> m_removedCheckpoints;
+};
+
+// Payload of a new checkpoint compressed on the save writer thread, it can be
+// read once m_done is set
+struct PendingEncode {
+	std::vector<char> m_payload;
+	PayloadEncoding m_encoding = PayloadEncoding::Raw;
+	uint64_t m_rawSize = 0;
+	std::atomic<bool> m_done = false;
+};
+
+// Sizes of the checkpoints of the active layer
+struct SaveLayerSize {
+	// The layer in the container and the blocks it refers to
+	uint64_t m_storedSize = 0;
+	// Payloads before compression
+	uint64_t m_rawSize = 0;
+	// Estimate for the decoded checkpoints
+	uint64_t m_memorySize = 0;
+};
+
 class $modify(ModPlayLayer, PlayLayer) {
 	struct Fields {
 		bool m_startedLoadingObjects = false;
 		LoadError m_loadError = LoadError::None;
 		bool m_hasAttemptedToLoadCheckpoints = false;
 
-		Ref<cocos2d::CCArray> m_persistentCheckpointArray = nullptr;
+		// Set once the level is set up, the checkpoints are loaded after that
+		bool m_hasSetUpCheckpoints = false;
+		CheckpointStore m_persistentCheckpoints;
 		Ref<cocos2d::CCSpriteBatchNode> m_persistentCheckpointBatchNode = nullptr;
 
 		unsigned int m_activeCheckpoint = 0;
 		unsigned int m_activeSaveLayer = 0;
 		unsigned int m_saveLayerCount = 0;
 		unsigned int m_ghostActiveCheckpoint = 0;
-
-		std::optional<size_t> m_levelStringHash;
+		unsigned int m_saveVersion = 0;
+		unsigned int m_nextCheckpointID = 1;
+		uint64_t m_journalSize = 0;
+		uint64_t m_journalLiveSize = 0;
+		std::vector<char> m_compressionDictionary;
+		bool m_triedTrainingDictionary = false;
+		// Payload of the first checkpoint saved in the layer, delta encoded
+		// payloads are stored as the difference from it
+		std::vector<char> m_saveBaseline;
+		// Scratch buffers reused by every decode in the layer, they're released
+		// when its checkpoints are unloaded
+		std::vector<char> m_decodeBuffer;
+		std::vector<char> m_deltaBuffer;
+		BlockStore m_blockStore;
+		SaveContainer m_saveContainer;
+		// Counts up every time a checkpoint is restored
+		uint64_t m_restoreCount = 0;
+		unsigned int m_saveBatchDepth = 0;
+		SaveBatch m_saveBatch;
+		StatsLog m_statsLog;
+		// Checkpoint the current attempt started from, deaths are counted
+		// towards it
+		Ref<PersistentCheckpoint> m_statsCheckpoint = nullptr;
+		// New checkpoint whose record is appended once it's compressed
+		Ref<PersistentCheckpoint> m_pendingCheckpoint = nullptr;
+		std::shared_ptr<PendingEncode> m_pendingEncode;
+		// Checkpoint resetLevel is restoring, the game passes its checkpoint
+		// object to loadFromCheckpoint
+		PersistentCheckpoint* m_restoringCheckpoint = nullptr;
 
 		CCNodeRGBA* m_pbCheckpointContainer = nullptr;
 	};
@@ -79,6 +155,7 @@ class $modify(ModPlayLayer, PlayLayer) {
 	void loadFromCheckpoint(CheckpointObject* p0);
 
 	void togglePracticeMode(bool enabled);
+	void destroyPlayer(PlayerObject* player, GameObject* object);
 
 	void storeCheckpoint(CheckpointObject* p0);
 
@@ -88,13 +165,88 @@ class $modify(ModPlayLayer, PlayLayer) {
 
 	// Data
 	void serializeCheckpoints();
+	bool canAppendToSave();
+	void appendToSave(const std::vector<char>& records);
+	void compactSaveIfNeeded();
+	void updateSaveLayerInfo();
+	// Batches can be nested, changes are written when the outermost one is
+	// committed
+	void beginSaveBatch();
+	void commitSaveBatch();
+	// Writes the changes of the open batches without closing them
+	void writeSaveBatch();
+	void saveStoredCheckpoint(PersistentCheckpoint* checkpoint);
+	// Waits for the pending checkpoint if it's still being compressed,
+	// anything that reads or writes the layer finishes it first
+	void finishPendingCheckpoint();
+	void dropPendingCheckpoint();
+	void appendCheckpointToSave(
+		PersistentCheckpoint* checkpoint, const std::vector<char>& payload
+	);
+	void saveRemovedCheckpoint(PersistentCheckpoint* checkpoint);
+	void saveCheckpointOrder();
+	bool shouldTrainDictionary();
+	bool shouldCreateBaseline();
+	std::vector<char> encodeCheckpointPayload(
+		PersistentCheckpoint* checkpoint, std::vector<char> payload
+	);
+	const char*
+	getStoredPayload(PersistentCheckpoint* checkpoint, const LayerView& save);
+	bool decodeStoredPayload(
+		PersistentCheckpoint* checkpoint, const char* storedPayload,
+		std::vector<char>& payload
+	);
+	std::vector<char> readRawCheckpointPayload(
+		PersistentCheckpoint* checkpoint, const LayerView& save
+	);
+	void loadBlockStore();
+	void enforceMemoryBudget();
+	// Other mods can ask for the sizes of the active layer with
+	// DispatchEvent<uint64_t*, uint64_t*, uint64_t*>(
+	// 	"kevadroz.practicecheckpointpermanence/get-layer-size", &storedSize,
+	// 	&rawSize, &memorySize
+	// ).post();
+	// and for the sections of a checkpoint of the layer, by index, with
+	// DispatchEvent<unsigned int, uint64_t*, uint64_t*>(
+	// 	"kevadroz.practicecheckpointpermanence/get-checkpoint-size", index,
+	// 	encodedSections, memorySections
+	// ).post();
+	// where both arrays have a size for each CheckpointSection
+	SaveLayerSize getSaveLayerSize();
+	uint64_t getCheckpointStoredSize(PersistentCheckpoint* checkpoint);
+	// The checkpoint is only decoded for as long as it's measured
+	std::pair<CheckpointSize, CheckpointSize>
+	measureCheckpoint(PersistentCheckpoint* checkpoint);
+	void releaseCheckpointBlocks(PersistentCheckpoint* checkpoint);
+	std::vector<char> createSaveHeader();
+	uint64_t getSaveHeaderSize(unsigned int saveVersion);
+	uint64_t getLevelIdentifier(LevelHash hash = CURRENT_LEVEL_HASH);
+	SaveLayerInfo createSaveLayerInfo();
 	void deserializeCheckpoints(bool ignoreVerification = false);
+	void rewriteDamagedSaveLayer();
+	std::vector<JournalEntry> readSaveJournal(
+		const LayerView& save, unsigned int saveVersion,
+		std::vector<char>& dictionary, std::vector<char>& baseline,
+		std::vector<char>* damagedRecords = nullptr
+	);
+	bool readJournalChunk(
+		ByteReader& reader, uint64_t layerOffset, unsigned int saveVersion,
+		JournalReplay& replay, std::vector<char>& dictionary,
+		std::vector<char>& baseline
+	);
 	void unloadPersistentCheckpoints();
-	std::variant<unsigned int, LoadError>
-	verifySaveStream(persistenceAPI::Stream& stream);
-	std::variant<unsigned int, LoadError>
-	verifySavePath(std::filesystem::path path);
-	std::filesystem::path getSavePath();
+	bool decodePersistentCheckpoint(PersistentCheckpoint* checkpoint);
+	std::optional<SaveHeader> readSaveHeader(ByteReader& reader);
+	std::variant<unsigned int, LoadError> verifySaveHeader(ByteReader& reader);
+	SaveLayerInfo readSaveLayerInfo(const LayerView& save);
+	std::filesystem::path getSaveBasePath();
+	std::filesystem::path getContainerPath();
+	std::filesystem::path getLegacySavePath(unsigned int saveLayer);
+	std::filesystem::path getLegacyManifestPath();
+	std::filesystem::path getBlockStorePath();
+	std::filesystem::path getStatsLogPath();
+	StatsLog& getStatsLog();
+	const CheckpointStats* getCheckpointStats(PersistentCheckpoint* checkpoint);
 
 	// Checkpoints
 	void nextCheckpoint();
@@ -102,7 +254,9 @@ class $modify(ModPlayLayer, PlayLayer) {
 	void
 	switchCurrentCheckpoint(unsigned int, bool ignoreLastCheckpoint = false);
 	void markPersistentCheckpoint();
-	unsigned int storePersistentCheckpoint(PersistentCheckpoint* checkpoint);
+	unsigned int storePersistentCheckpoint(
+		PersistentCheckpoint* checkpoint, bool sorted = true
+	);
 	void removePersistentCheckpoint(PersistentCheckpoint* checkpoint);
 	void removeCurrentPersistentCheckpoint();
 	void removeGhostPersistentCheckpoint();
@@ -115,6 +269,20 @@ class $modify(ModPlayLayer, PlayLayer) {
 	void removeCurrentSaveLayer();
 	void swapSaveLayers(unsigned int left, unsigned int right);
 	void updateSaveLayerCount();
+	void loadSaveContainer();
+	void migrateLegacySaveLayers();
+	void removeLegacySaveLayers();
+	void setSaveLayerInfo(unsigned int saveLayer, SaveLayerInfo info);
+	bool copyCheckpointToSaveLayer(
+		PersistentCheckpoint* checkpoint, unsigned int saveLayer
+	);
+	bool restoreBackupLevel(const BackupSnapshot& snapshot);
+	bool
+	restoreBackupLayer(const BackupSnapshot& snapshot, unsigned int saveLayer);
+	void restoreBackupStats(
+		const BackupSnapshot& snapshot, unsigned int saveLayer,
+		unsigned int restoredLayer, const std::vector<unsigned int>& ids
+	);
 
 	static void onModify(auto& self) {
 		if (!self.setHookPriorityPost(
@@ -5,7 +5,7 @@ void ModPlayLayer::nextCheckpoint() {
 		return;
 
 	unsigned int nextCheckpoint = m_fields->m_activeCheckpoint + 1;
-	if (nextCheckpoint > m_fields->m_persistentCheckpointArray->count())
+	if (nextCheckpoint > m_fields->m_persistentCheckpoints.count())
 		nextCheckpoint = 0;
 	switchCurrentCheckpoint(nextCheckpoint);
 }
@@ -16,7 +16,7 @@ void ModPlayLayer::previousCheckpoint() {
 
 	unsigned int nextCheckpoint = m_fields->m_activeCheckpoint - 1;
 	if (m_fields->m_activeCheckpoint == 0)
-		nextCheckpoint = m_fields->m_persistentCheckpointArray->count();
+		nextCheckpoint = m_fields->m_persistentCheckpoints.count();
 	switchCurrentCheckpoint(nextCheckpoint);
 }
 
@@ -29,18 +29,11 @@ void ModPlayLayer::switchCurrentCheckpoint(
 		return;
 
 	if (!ignoreLastCheckpoint && m_fields->m_activeCheckpoint != 0)
-		reinterpret_cast<PersistentCheckpoint*>(
-			m_fields->m_persistentCheckpointArray->objectAtIndex(
-				m_fields->m_activeCheckpoint - 1
-			)
-		)
+		m_fields->m_persistentCheckpoints.at(m_fields->m_activeCheckpoint - 1)
 			->toggleActive(false);
 
 	if (nextCheckpoint != 0)
-		reinterpret_cast<PersistentCheckpoint*>(
-			(m_fields->m_persistentCheckpointArray)
-				->objectAtIndex(nextCheckpoint - 1)
-		)
+		m_fields->m_persistentCheckpoints.at(nextCheckpoint - 1)
 			->toggleActive(true);
 
 	m_fields->m_ghostActiveCheckpoint = 0;
@@ -71,37 +64,32 @@ void ModPlayLayer::markPersistentCheckpoint() {
 			m_effectManager->m_persistentItemCountMap,
 			m_effectManager->m_persistentTimerItemSet
 		);
+	checkpoint->m_id = m_fields->m_nextCheckpointID++;
+	checkpoint->m_lastRestored = ++m_fields->m_restoreCount;
 	m_fields->m_ghostActiveCheckpoint = storePersistentCheckpoint(checkpoint) + 1;
-	serializeCheckpoints();
+	saveStoredCheckpoint(checkpoint);
 
-	if (m_fields->m_persistentCheckpointArray->count() == 1)
+	if (m_fields->m_persistentCheckpoints.count() == 1)
 		updateSaveLayerCount();
 
+	enforceMemoryBudget();
+
 	updateModUI();
 }
 
-unsigned int
-ModPlayLayer::storePersistentCheckpoint(PersistentCheckpoint* checkpoint) {
-	CCArray* array = m_fields->m_persistentCheckpointArray;
-
-	unsigned int index = 0;
-	if (array->count() > 0)
-		for (PersistentCheckpoint* arrayCheckpoint :
-			  CCArrayExt<PersistentCheckpoint*>(array)) {
-			if (m_isPlatformer
-					 ? arrayCheckpoint->m_time > checkpoint->m_time
-					 : arrayCheckpoint->m_percent > checkpoint->m_percent)
-				break;
-			index++;
-		}
+unsigned int ModPlayLayer::storePersistentCheckpoint(
+	PersistentCheckpoint* checkpoint, bool sorted
+) {
+	CheckpointStore& store = m_fields->m_persistentCheckpoints;
+
+	unsigned int index = store.count();
+	if (sorted)
+		index = store.getSortedIndex(checkpoint, m_isPlatformer);
 
 	m_fields->m_persistentCheckpointBatchNode->addChild(
 		checkpoint->m_checkpoint->m_physicalCheckpointObject
 	);
-	if (index < array->count())
-		array->insertObject(checkpoint, index);
-	else
-		array->addObject(checkpoint);
+	store.insert(index, checkpoint);
 
 	return index;
 }
@@ -114,10 +102,15 @@ void ModPlayLayer::removePersistentCheckpoint(
 		return;
 	}
 
-	assert(m_fields->m_persistentCheckpointArray->containsObject(checkpoint));
+	assert(m_fields->m_persistentCheckpoints.contains(checkpoint));
+
+	// The store holds the last reference when removing from the manager
+	Ref<PersistentCheckpoint> removedCheckpoint = checkpoint;
+
+	getStatsLog().removeStats(m_fields->m_activeSaveLayer, checkpoint->m_id);
 
 	unsigned int removeIndex =
-		m_fields->m_persistentCheckpointArray->indexOfObject(checkpoint);
+		m_fields->m_persistentCheckpoints.indexOf(checkpoint);
 
 	bool updateActiveCheckpoint =
 		m_fields->m_activeCheckpoint > 0 &
@@ -126,7 +119,7 @@ void ModPlayLayer::removePersistentCheckpoint(
 		m_fields->m_activeCheckpoint > 0 && updateActiveCheckpoint;
 
 	checkpoint->m_checkpoint->m_physicalCheckpointObject->removeFromParent();
-	m_fields->m_persistentCheckpointArray->removeObjectAtIndex(removeIndex);
+	m_fields->m_persistentCheckpoints.remove(removeIndex);
 
 	if (removeIndex + 1 == m_fields->m_ghostActiveCheckpoint)
 		m_fields->m_ghostActiveCheckpoint = 0;
@@ -142,7 +135,7 @@ void ModPlayLayer::removePersistentCheckpoint(
 		updateModUI();
 	}
 
-	serializeCheckpoints();
+	saveRemovedCheckpoint(checkpoint);
 }
 
 void ModPlayLayer::removeCurrentPersistentCheckpoint() {
@@ -152,12 +145,9 @@ void ModPlayLayer::removeCurrentPersistentCheckpoint() {
 	}
 
 	if (m_fields->m_activeCheckpoint > 0) {
-		PersistentCheckpoint* checkpoint =
-			reinterpret_cast<PersistentCheckpoint*>(
-				m_fields->m_persistentCheckpointArray->objectAtIndex(
-					m_fields->m_activeCheckpoint - 1
-				)
-			);
+		PersistentCheckpoint* checkpoint = m_fields->m_persistentCheckpoints.at(
+			m_fields->m_activeCheckpoint - 1
+		);
 		removePersistentCheckpoint(checkpoint);
 	}
 }
@@ -166,12 +156,9 @@ void ModPlayLayer::removeGhostPersistentCheckpoint() {
 	assert(m_fields->m_loadError == LoadError::None);
 
 	if (m_fields->m_ghostActiveCheckpoint > 0) {
-		PersistentCheckpoint* checkpoint =
-			reinterpret_cast<PersistentCheckpoint*>(
-				m_fields->m_persistentCheckpointArray->objectAtIndex(
-					m_fields->m_ghostActiveCheckpoint - 1
-				)
-			);
+		PersistentCheckpoint* checkpoint = m_fields->m_persistentCheckpoints.at(
+			m_fields->m_ghostActiveCheckpoint - 1
+		);
 		removePersistentCheckpoint(checkpoint);
 	}
 }
@@ -179,7 +166,7 @@ void ModPlayLayer::removeGhostPersistentCheckpoint() {
 void ModPlayLayer::swapPersistentCheckpoints(
 	unsigned int left, unsigned int right
 ) {
-	m_fields->m_persistentCheckpointArray->exchangeObjectAtIndex(left, right);
+	m_fields->m_persistentCheckpoints.swap(left, right);
 
 	if (m_fields->m_activeCheckpoint == left + 1)
 		m_fields->m_activeCheckpoint = right + 1;
@@ -191,6 +178,6 @@ void ModPlayLayer::swapPersistentCheckpoints(
 	else if (m_fields->m_ghostActiveCheckpoint == right + 1)
 		m_fields->m_ghostActiveCheckpoint = left + 1;
 
-	serializeCheckpoints();
+	saveCheckpointOrder();
 	updateModUI();
 }
@@ -1,73 +1,907 @@
 #include "PlayLayer.hpp"
+#include "../Save/Delta.hpp"
+#include "../Save/MappedFile.hpp"
+#include "../Save/Quarantine.hpp"
+#include "../Save/SavePath.hpp"
+#include "../Save/SaveJournal.hpp"
+#include "../Save/SaveWriter.hpp"
 #include "sabe.persistenceapi/include/util/Stream.hpp"
 #include <filesystem>
 #include <optional>
+#include <utility>
 #include <variant>
 
 const char SAVE_HEADER[] = "PCP SAVE FILE";
-const unsigned int CURRENT_VERSION = 2;
+const unsigned int CURRENT_VERSION = 9;
+// First version with the level hash in the header
+const unsigned int LEVEL_HASH_VERSION = 8;
 
+// Journals are compacted once their dead records take more space than
+// both this and the live checkpoints
+const uint64_t MIN_COMPACTION_SLACK = 1024 * 1024;
+
+// Rewrites the whole layer as a compacted journal
 void ModPlayLayer::serializeCheckpoints() {
 	if (m_fields->m_loadError != LoadError::None)
 		return;
 
-	unsigned int checkpointCount =
-		m_fields->m_persistentCheckpointArray->count();
+	finishPendingCheckpoint();
+
+	if (m_fields->m_saveBatchDepth > 0) {
+		m_fields->m_saveBatch.m_rewrite = true;
+		return;
+	}
+
+	CheckpointStore& store = m_fields->m_persistentCheckpoints;
+	unsigned int checkpointCount = store.count();
 
 	if (checkpointCount == 0) {
 		removeCurrentSaveLayer();
 		return;
 	}
 
-	char platform = PLATFORM;
-	unsigned int version = CURRENT_VERSION;
+	loadSaveContainer();
+	SaveContainer& container = m_fields->m_saveContainer;
+	const ContainerLayer* previousLayer =
+		container.getLayer(m_fields->m_activeSaveLayer);
+
+	// Checkpoints that are already saved are copied as they are from the old
+	// layer
+	MappedFile previousContainer;
+	LayerView previousSave;
+	for (PersistentCheckpoint* checkpoint : store)
+		if (previousLayer != nullptr && checkpoint->m_payloadSize != 0) {
+			SaveWriter::get()->flush();
+			if (previousContainer.open(container.getPath()))
+				previousSave = LayerView(previousContainer, *previousLayer);
+			break;
+		}
 
-	persistenceAPI::Stream stream;
-	stream.setFile(string::pathToString(getSavePath()), 2, true);
+	// Payloads compressed without the dictionary are recompressed once it's
+	// trained
+	bool recompress = false;
+	if (shouldTrainDictionary()) {
+		m_fields->m_triedTrainingDictionary = true;
 
-	stream.write((char*)SAVE_HEADER, sizeof(SAVE_HEADER));
-	stream << version;
-	stream << platform;
+		std::vector<std::vector<char>> samples;
+		for (PersistentCheckpoint* checkpoint : store)
+			samples.push_back(readRawCheckpointPayload(checkpoint, previousSave)
+			);
 
-	if (m_level->m_levelType != GJLevelType::Editor)
-		stream << m_level->m_levelVersion;
+		m_fields->m_compressionDictionary = trainDictionary(samples);
+		recompress = !m_fields->m_compressionDictionary.empty();
+	}
+
+	// The baseline never changes once the layer has one, so delta encoded
+	// payloads can always be copied as they are
+	if (shouldCreateBaseline()) {
+		m_fields->m_saveBaseline =
+			readRawCheckpointPayload(store.at(0), previousSave);
+		recompress = !m_fields->m_saveBaseline.empty();
+	}
+
+	// Payloads that have to be encoded again are encoded first so the size of
+	// the layer is known and its buffer is only allocated once
+	std::vector<const char*> storedPayloads(checkpointCount);
+	std::vector<std::vector<char>> encodedPayloads(checkpointCount);
+	uint64_t liveSize = 0;
+
+	for (unsigned int i = 0; i < checkpointCount; i++) {
+		PersistentCheckpoint* checkpoint = store.at(i);
+		bool inBlockStore =
+			checkpoint->m_payloadEncoding == PayloadEncoding::Blocks;
+		storedPayloads[i] = getStoredPayload(checkpoint, previousSave);
+
+		if (storedPayloads[i] == nullptr || (recompress && !inBlockStore)) {
+			encodedPayloads[i] = encodeCheckpointPayload(
+				checkpoint, readRawCheckpointPayload(checkpoint, previousSave)
+			);
+			storedPayloads[i] = encodedPayloads[i].data();
+			checkpoint->m_payloadSize = encodedPayloads[i].size();
+		}
+
+		liveSize += getCheckpointRecordSize(checkpoint);
+	}
+
+	std::vector<char> save = createSaveHeader();
+	uint64_t saveSize =
+		save.size() + liveSize + getOrderRecordSize(checkpointCount);
+	if (!m_fields->m_compressionDictionary.empty())
+		saveSize += RECORD_HEADER_SIZE + m_fields->m_compressionDictionary.size();
+	if (!m_fields->m_saveBaseline.empty())
+		saveSize += RECORD_HEADER_SIZE + m_fields->m_saveBaseline.size();
+	save.reserve(saveSize);
+
+	if (!m_fields->m_compressionDictionary.empty())
+		appendDictionaryRecord(save, m_fields->m_compressionDictionary);
+	if (!m_fields->m_saveBaseline.empty())
+		appendBaselineRecord(save, m_fields->m_saveBaseline);
+
+	for (unsigned int i = 0; i < checkpointCount; i++) {
+		PersistentCheckpoint* checkpoint = store.at(i);
+		checkpoint->m_payloadOffset = appendCheckpointRecord(
+			save, checkpoint, storedPayloads[i], checkpoint->m_payloadSize
+		);
+		encodedPayloads[i] = std::vector<char>();
+	}
+
+	appendOrderRecord(save, store);
+	previousSave = LayerView();
+	previousContainer.close();
+
+	m_fields->m_saveVersion = CURRENT_VERSION;
+	m_fields->m_journalSize = save.size();
+	m_fields->m_journalLiveSize = liveSize;
+
+	container.writeLayer(
+		m_fields->m_activeSaveLayer, std::move(save), createSaveLayerInfo()
+	);
+}
+
+// Journal writes fall back to a full rewrite when the file isn't a journal
+// yet (new layers and saves from older versions)
+bool ModPlayLayer::canAppendToSave() {
+	return m_fields->m_loadError == LoadError::None &&
+			 m_fields->m_saveVersion == CURRENT_VERSION;
+}
+
+// Records of a batch already count towards the journal size, so offsets
+// into them are final
+void ModPlayLayer::appendToSave(const std::vector<char>& records) {
+	m_fields->m_journalSize += records.size();
+
+	if (m_fields->m_saveBatchDepth > 0) {
+		std::vector<char>& batchRecords = m_fields->m_saveBatch.m_records;
+		batchRecords.insert(batchRecords.end(), records.begin(), records.end());
+		return;
+	}
+
+	m_fields->m_saveContainer.appendToLayer(
+		m_fields->m_activeSaveLayer, records
+	);
+	compactSaveIfNeeded();
+}
+
+void ModPlayLayer::compactSaveIfNeeded() {
+	uint64_t slack = m_fields->m_journalSize - m_fields->m_journalLiveSize;
+	if (slack > std::max(m_fields->m_journalLiveSize, MIN_COMPACTION_SLACK))
+		serializeCheckpoints();
+}
+
+// Deduplicated payloads go to the block store instead
+static bool isDeltaEncodingEnabled() {
+	return Mod::get()->getSettingValue<bool>("delta-saves") &&
+			 !Mod::get()->getSettingValue<bool>("deduplicate-saves");
+}
+
+// Compresses or delta encodes the payload in place, it's kept raw when that
+// doesn't make it smaller. It only works on bytes, so it can run on the save
+// writer thread. The baseline is empty when delta encoding is off
+static PayloadEncoding encodePayloadBytes(
+	std::vector<char>& payload, CompressionLevel level,
+	const std::vector<char>& dictionary, const std::vector<char>& baseline
+) {
+	if (!baseline.empty()) {
+		std::vector<char> delta =
+			encodeDelta(baseline, payload.data(), payload.size());
+		PayloadEncoding encoding = PayloadEncoding::Delta;
+
+		if (level != CompressionLevel::None) {
+			std::vector<char> compressedDelta;
+			appendValue(compressedDelta, (uint64_t)delta.size());
+			std::vector<char> compressed =
+				compressPayload(delta.data(), delta.size(), {}, level);
+			compressedDelta.insert(
+				compressedDelta.end(), compressed.begin(), compressed.end()
+			);
+
+			if (compressedDelta.size() < delta.size()) {
+				delta = std::move(compressedDelta);
+				encoding = PayloadEncoding::DeltaLZ;
+			}
+		}
+
+		if (delta.size() >= payload.size())
+			return PayloadEncoding::Raw;
+
+		payload = std::move(delta);
+		return encoding;
+	}
+
+	if (level == CompressionLevel::None)
+		return PayloadEncoding::Raw;
+
+	std::vector<char> compressedPayload =
+		compressPayload(payload.data(), payload.size(), dictionary, level);
+
+	if (compressedPayload.size() >= payload.size())
+		return PayloadEncoding::Raw;
+
+	payload = std::move(compressedPayload);
+	if (dictionary.empty())
+		return PayloadEncoding::LZ;
+	return PayloadEncoding::LZDictionary;
+}
+
+// The checkpoint is encoded on the main thread since the game changes the
+// objects it refers to. Payloads outside the block store are then compressed
+// on the save writer thread, and their record is appended once that's done
+void ModPlayLayer::saveStoredCheckpoint(PersistentCheckpoint* checkpoint) {
+	finishPendingCheckpoint();
+
+	if (!canAppendToSave() || shouldTrainDictionary() ||
+		 shouldCreateBaseline()) {
+		serializeCheckpoints();
+		return;
+	}
+
+	std::vector<char> payload = checkpoint->encode();
+
+	// The block store is only used on the main thread
+	if (Mod::get()->getSettingValue<bool>("deduplicate-saves")) {
+		appendCheckpointToSave(
+			checkpoint, encodeCheckpointPayload(checkpoint, std::move(payload))
+		);
+		return;
+	}
+
+	auto encode = std::make_shared<PendingEncode>();
+	encode->m_payload = std::move(payload);
+	m_fields->m_pendingCheckpoint = checkpoint;
+	m_fields->m_pendingEncode = encode;
+
+	std::vector<char> baseline;
+	if (isDeltaEncodingEnabled())
+		baseline = m_fields->m_saveBaseline;
+
+	SaveWriter::get()->queueTask(
+		[checkpoint, encode, level = getCompressionLevel(),
+		 dictionary = m_fields->m_compressionDictionary, baseline]() {
+			encode->m_rawSize = encode->m_payload.size();
+			encode->m_encoding = encodePayloadBytes(
+				encode->m_payload, level, dictionary, baseline
+			);
+			encode->m_done = true;
+
+			Loader::get()->queueInMainThread([checkpoint]() {
+				ModPlayLayer* playLayer =
+					static_cast<ModPlayLayer*>(PlayLayer::get());
+				if (playLayer != nullptr &&
+					 playLayer->m_fields->m_pendingCheckpoint == checkpoint)
+					playLayer->finishPendingCheckpoint();
+			});
+		}
+	);
+}
+
+// The checkpoint isn't saved if it was removed or the layer was rewritten
+// with it in the meantime
+void ModPlayLayer::finishPendingCheckpoint() {
+	if (m_fields->m_pendingCheckpoint == nullptr)
+		return;
+
+	if (!m_fields->m_pendingEncode->m_done)
+		SaveWriter::get()->flush();
+
+	Ref<PersistentCheckpoint> checkpoint =
+		std::exchange(m_fields->m_pendingCheckpoint, nullptr);
+	std::shared_ptr<PendingEncode> encode =
+		std::exchange(m_fields->m_pendingEncode, nullptr);
+
+	if (checkpoint->m_payloadSize != 0 ||
+		 !m_fields->m_persistentCheckpoints.contains(checkpoint))
+		return;
+
+	checkpoint->m_payloadEncoding = encode->m_encoding;
+	checkpoint->m_payloadRawSize = encode->m_rawSize;
+	checkpoint->m_blocks.clear();
+	appendCheckpointToSave(checkpoint, std::move(encode->m_payload));
+}
+
+// Drops the pending checkpoint without saving it, for when its layer is
+// removed
+void ModPlayLayer::dropPendingCheckpoint() {
+	if (m_fields->m_pendingCheckpoint == nullptr)
+		return;
+
+	if (!m_fields->m_pendingEncode->m_done)
+		SaveWriter::get()->flush();
+
+	m_fields->m_pendingCheckpoint = nullptr;
+	m_fields->m_pendingEncode = nullptr;
+}
+
+void ModPlayLayer::appendCheckpointToSave(
+	PersistentCheckpoint* checkpoint, const std::vector<char>& payload
+) {
+	std::vector<char> record;
+	uint64_t payloadOffset = appendCheckpointRecord(
+		record, checkpoint, payload.data(), payload.size()
+	);
+
+	checkpoint->m_payloadOffset = m_fields->m_journalSize + payloadOffset;
+	checkpoint->m_payloadSize = payload.size();
+	m_fields->m_journalLiveSize += getCheckpointRecordSize(checkpoint);
+
+	appendToSave(record);
+	updateSaveLayerInfo();
+}
+
+// Blocks are released after the removal is written, so a crash in between
+// can only leave unused blocks behind
+void ModPlayLayer::saveRemovedCheckpoint(PersistentCheckpoint* checkpoint) {
+	finishPendingCheckpoint();
+
+	if (!canAppendToSave() ||
+		 m_fields->m_persistentCheckpoints.count() == 0)
+		serializeCheckpoints();
+	else {
+		std::vector<char> record;
+		appendRemoveRecord(record, checkpoint->m_id);
+
+		m_fields->m_journalLiveSize -= getCheckpointRecordSize(checkpoint);
+
+		appendToSave(record);
+		updateSaveLayerInfo();
+	}
+
+	if (m_fields->m_saveBatchDepth > 0)
+		m_fields->m_saveBatch.m_removedCheckpoints.push_back(checkpoint);
+	else
+		releaseCheckpointBlocks(checkpoint);
+}
+
+void ModPlayLayer::saveCheckpointOrder() {
+	finishPendingCheckpoint();
+
+	if (!canAppendToSave()) {
+		serializeCheckpoints();
+		return;
+	}
+
+	// Only the final order of a batch is written
+	if (m_fields->m_saveBatchDepth > 0) {
+		m_fields->m_saveBatch.m_orderChanged = true;
+		return;
+	}
+
+	std::vector<char> record;
+	appendOrderRecord(record, m_fields->m_persistentCheckpoints);
+
+	appendToSave(record);
+}
+
+void ModPlayLayer::updateSaveLayerInfo() {
+	if (m_fields->m_saveBatchDepth > 0)
+		m_fields->m_saveBatch.m_layerInfoChanged = true;
+	else
+		setSaveLayerInfo(m_fields->m_activeSaveLayer, createSaveLayerInfo());
+}
+
+void ModPlayLayer::beginSaveBatch() {
+	m_fields->m_saveBatchDepth++;
+}
+
+void ModPlayLayer::commitSaveBatch() {
+	if (m_fields->m_saveBatchDepth == 0)
+		return;
+
+	m_fields->m_saveBatchDepth--;
+	if (m_fields->m_saveBatchDepth == 0)
+		writeSaveBatch();
+}
+
+// The records of the batch go out in a single append. If anything in the
+// batch needed the layer to be rewritten, it's rewritten after them
+void ModPlayLayer::writeSaveBatch() {
+	finishPendingCheckpoint();
+
+	unsigned int batchDepth = std::exchange(m_fields->m_saveBatchDepth, 0);
+	SaveBatch batch = std::exchange(m_fields->m_saveBatch, SaveBatch());
+
+	if (batch.m_orderChanged && !batch.m_rewrite) {
+		uint64_t recordsSize = batch.m_records.size();
+		appendOrderRecord(batch.m_records, m_fields->m_persistentCheckpoints);
+		m_fields->m_journalSize += batch.m_records.size() - recordsSize;
+	}
+
+	if (!batch.m_records.empty()) {
+		m_fields->m_saveContainer.appendToLayer(
+			m_fields->m_activeSaveLayer, std::move(batch.m_records)
+		);
+		if (!batch.m_rewrite)
+			compactSaveIfNeeded();
+	}
+
+	// The rewrite can create the layer
+	if (batch.m_rewrite) {
+		serializeCheckpoints();
+		updateSaveLayerCount();
+	} else if (batch.m_layerInfoChanged)
+		setSaveLayerInfo(m_fields->m_activeSaveLayer, createSaveLayerInfo());
+
+	for (PersistentCheckpoint* checkpoint : batch.m_removedCheckpoints)
+		releaseCheckpointBlocks(checkpoint);
+
+	m_fields->m_saveBatchDepth = batchDepth;
+}
+
+// The checkpoint's record is appended to the other layer as it is, only
+// reading the metadata of that layer. Payloads compressed with a dictionary
+// the other layer doesn't have are recompressed. A layer right after the last
+// one is created
+bool ModPlayLayer::copyCheckpointToSaveLayer(
+	PersistentCheckpoint* checkpoint, unsigned int saveLayer
+) {
+	if (m_fields->m_loadError != LoadError::None ||
+		 saveLayer == m_fields->m_activeSaveLayer)
+		return false;
+
+	// Stored payloads are read from the file
+	writeSaveBatch();
+
+	loadSaveContainer();
+	SaveContainer& container = m_fields->m_saveContainer;
+	const ContainerLayer* sourceLayer =
+		container.getLayer(m_fields->m_activeSaveLayer);
+	const ContainerLayer* targetLayer = container.getLayer(saveLayer);
+	if (targetLayer == nullptr && saveLayer != container.getLayerCount())
+		return false;
+
+	SaveWriter::get()->flush();
+
+	MappedFile containerFile;
+	LayerView source;
+	LayerView target;
+	if (sourceLayer != nullptr || targetLayer != nullptr) {
+		if (!containerFile.open(container.getPath()))
+			return false;
+
+		if (sourceLayer != nullptr)
+			source = LayerView(containerFile, *sourceLayer);
+		if (targetLayer != nullptr)
+			target = LayerView(containerFile, *targetLayer);
+	}
+
+	// Records can only be appended to journals of the current version that
+	// would load in this level
+	std::vector<char> targetDictionary;
+	std::vector<char> targetBaseline;
+	unsigned int targetCheckpointCount = 0;
+	unsigned int targetID = 1;
+	if (targetLayer != nullptr) {
+		if (targetLayer->m_chunks.empty())
+			return false;
+
+		ByteReader reader = target.getChunkReader(targetLayer->m_chunks.front());
+		std::variant<unsigned int, LoadError> verificationResult =
+			verifySaveHeader(reader);
+		if (std::holds_alternative<LoadError>(verificationResult) ||
+			 std::get<unsigned int>(verificationResult) != CURRENT_VERSION)
+			return false;
+
+		std::vector<JournalEntry> entries = readSaveJournal(
+			target, CURRENT_VERSION, targetDictionary, targetBaseline
+		);
+
+		targetCheckpointCount = entries.size();
+		for (const JournalEntry& entry : entries)
+			targetID = std::max(targetID, entry.m_id + 1);
+	}
+
+	JournalEntry entry;
+	entry.m_id = targetID;
+	entry.m_objectPos = checkpoint->m_objectPos;
+	entry.m_time = checkpoint->m_time;
+	entry.m_percent = checkpoint->m_percent;
+	entry.m_payloadSize = checkpoint->m_payloadSize;
+	entry.m_payloadEncoding = checkpoint->m_payloadEncoding;
+	entry.m_payloadRawSize = checkpoint->m_payloadRawSize;
+	entry.m_blocks = checkpoint->m_blocks;
+
+	const char* payload = getStoredPayload(checkpoint, source);
+	std::vector<char> encodedPayload;
+
+	bool deltaEncoded = entry.m_payloadEncoding == PayloadEncoding::Delta ||
+							  entry.m_payloadEncoding == PayloadEncoding::DeltaLZ;
+
+	if (payload == nullptr ||
+		 (entry.m_payloadEncoding == PayloadEncoding::LZDictionary &&
+		  targetDictionary != m_fields->m_compressionDictionary) ||
+		 (deltaEncoded && targetBaseline != m_fields->m_saveBaseline)) {
+		encodedPayload = readRawCheckpointPayload(checkpoint, source);
+		if (encodedPayload.empty())
+			return false;
+
+		entry.m_payloadEncoding = PayloadEncoding::Raw;
+		entry.m_payloadRawSize = encodedPayload.size();
+		entry.m_blocks.clear();
+
+		CompressionLevel level = getCompressionLevel();
+		if (level != CompressionLevel::None) {
+			std::vector<char> compressedPayload = compressPayload(
+				encodedPayload.data(), encodedPayload.size(), targetDictionary,
+				level
+			);
+
+			if (compressedPayload.size() < encodedPayload.size()) {
+				encodedPayload = std::move(compressedPayload);
+				entry.m_payloadEncoding = targetDictionary.empty()
+												  ? PayloadEncoding::LZ
+												  : PayloadEncoding::LZDictionary;
+			}
+		}
+
+		entry.m_payloadSize = encodedPayload.size();
+		payload = encodedPayload.data();
+	}
+
+	std::vector<char> records;
+	if (targetLayer == nullptr)
+		records = createSaveHeader();
+	appendCheckpointRecord(records, entry, payload);
+
+	source = LayerView();
+	target = LayerView();
+	containerFile.close();
+
+	// Both layers now refer to the blocks
+	if (entry.m_payloadEncoding == PayloadEncoding::Blocks) {
+		loadBlockStore();
+		m_fields->m_blockStore.retainBlocks(entry.m_blocks);
+	}
+
+	SaveLayerInfo info = createSaveLayerInfo();
+	info.m_checkpointCount = targetCheckpointCount + 1;
+
+	if (targetLayer == nullptr)
+		container.writeLayer(saveLayer, std::move(records), info);
 	else {
-		if (!m_fields->m_levelStringHash.has_value())
-			m_fields->m_levelStringHash = c_stringHasher(m_level->m_levelString);
+		container.appendToLayer(saveLayer, std::move(records));
+		container.setLayerInfo(saveLayer, info);
+	}
+
+	// The stats follow the checkpoint under its ID in the other layer
+	getStatsLog().copyStats(
+		m_fields->m_activeSaveLayer, checkpoint->m_id, saveLayer, entry.m_id
+	);
+
+	updateSaveLayerCount();
+	return true;
+}
+
+// The dictionary is trained once per session when a layer has enough
+// checkpoints, saving a checkpoint then rewrites the layer to include it
+bool ModPlayLayer::shouldTrainDictionary() {
+	return getCompressionLevel() != CompressionLevel::None &&
+			 !Mod::get()->getSettingValue<bool>("deduplicate-saves") &&
+			 !isDeltaEncodingEnabled() &&
+			 m_fields->m_compressionDictionary.empty() &&
+			 !m_fields->m_triedTrainingDictionary &&
+			 m_fields->m_persistentCheckpoints.count() >= MIN_DICTIONARY_SAMPLES;
+}
+
+// Layers get their baseline from the first checkpoint saved in them, the
+// layer is then rewritten with it like with the dictionary
+bool ModPlayLayer::shouldCreateBaseline() {
+	return isDeltaEncodingEnabled() && m_fields->m_saveBaseline.empty() &&
+			 m_fields->m_persistentCheckpoints.count() > 0;
+}
 
-		stream << m_fields->m_levelStringHash.value();
+// Payloads go to the block store when deduplication is on, otherwise they're
+// stored as the difference from the layer baseline or compressed into the
+// record. Payloads that don't get smaller are kept raw
+std::vector<char> ModPlayLayer::encodeCheckpointPayload(
+	PersistentCheckpoint* checkpoint, std::vector<char> payload
+) {
+	checkpoint->m_payloadEncoding = PayloadEncoding::Raw;
+	checkpoint->m_payloadRawSize = payload.size();
+	checkpoint->m_blocks.clear();
+
+	CompressionLevel level = getCompressionLevel();
+
+	if (Mod::get()->getSettingValue<bool>("deduplicate-saves")) {
+		loadBlockStore();
+
+		std::optional<std::vector<uint64_t>> blocks =
+			m_fields->m_blockStore.storePayload(payload, level);
+		if (blocks.has_value()) {
+			checkpoint->m_payloadEncoding = PayloadEncoding::Blocks;
+			checkpoint->m_blocks = std::move(blocks.value());
+
+			std::vector<char> blockList;
+			for (uint64_t hash : checkpoint->m_blocks)
+				appendValue(blockList, hash);
+
+			return blockList;
+		}
 	}
 
-	stream << checkpointCount;
+	static const std::vector<char> noBaseline;
+	checkpoint->m_payloadEncoding = encodePayloadBytes(
+		payload, level, m_fields->m_compressionDictionary,
+		isDeltaEncodingEnabled() ? m_fields->m_saveBaseline : noBaseline
+	);
+	return payload;
+}
+
+// Stored payloads are only read when the checkpoint has been saved and its
+// payload is inside the layer
+const char* ModPlayLayer::getStoredPayload(
+	PersistentCheckpoint* checkpoint, const LayerView& save
+) {
+	if (checkpoint->m_payloadSize == 0)
+		return nullptr;
+
+	return save.get(checkpoint->m_payloadOffset, checkpoint->m_payloadSize);
+}
+
+// The payload is decoded into the given buffer, so decoding into the same
+// buffer again doesn't allocate
+bool ModPlayLayer::decodeStoredPayload(
+	PersistentCheckpoint* checkpoint, const char* storedPayload,
+	std::vector<char>& payload
+) {
+	if (storedPayload == nullptr &&
+		 checkpoint->m_payloadEncoding != PayloadEncoding::Blocks)
+		return false;
 
-	for (PersistentCheckpoint* checkpoint : CCArrayExt<PersistentCheckpoint*>(
-			  m_fields->m_persistentCheckpointArray
-		  )) {
-		checkpoint->serialize(stream);
+	switch (checkpoint->m_payloadEncoding) {
+	case PayloadEncoding::Raw:
+		payload.assign(storedPayload, storedPayload + checkpoint->m_payloadSize);
+		return true;
+	case PayloadEncoding::LZ:
+	case PayloadEncoding::LZDictionary: {
+		const std::vector<char> noDictionary;
+		const std::vector<char>* dictionary = &noDictionary;
+		if (checkpoint->m_payloadEncoding == PayloadEncoding::LZDictionary)
+			dictionary = &m_fields->m_compressionDictionary;
+
+		return decompressPayload(
+			storedPayload, checkpoint->m_payloadSize, *dictionary, payload,
+			checkpoint->m_payloadRawSize
+		);
 	}
+	case PayloadEncoding::Blocks:
+		loadBlockStore();
+		return m_fields->m_blockStore.readPayload(
+			checkpoint->m_blocks, checkpoint->m_payloadRawSize, payload
+		);
+	case PayloadEncoding::Delta:
+	case PayloadEncoding::DeltaLZ: {
+		const char* delta = storedPayload;
+		uint64_t deltaSize = checkpoint->m_payloadSize;
+
+		std::vector<char>& decompressedDelta = m_fields->m_deltaBuffer;
+		if (checkpoint->m_payloadEncoding == PayloadEncoding::DeltaLZ) {
+			ByteReader reader(storedPayload, checkpoint->m_payloadSize);
+			if (!reader.read(deltaSize) ||
+				 !decompressPayload(
+					 storedPayload + reader.position(), reader.remaining(), {},
+					 decompressedDelta, deltaSize
+				 ))
+				return false;
+
+			delta = decompressedDelta.data();
+		}
 
-	stream.end();
+		return decodeDelta(
+			delta, deltaSize, m_fields->m_saveBaseline, payload,
+			checkpoint->m_payloadRawSize
+		);
+	}
+	default:
+		return false;
+	}
+}
+
+// Gets the uncompressed payload of a checkpoint, either from the previous
+// save or by encoding it if it hasn't been saved yet
+std::vector<char> ModPlayLayer::readRawCheckpointPayload(
+	PersistentCheckpoint* checkpoint, const LayerView& save
+) {
+	if (checkpoint->m_payloadSize != 0) {
+		std::vector<char> payload;
+		if (decodeStoredPayload(
+				 checkpoint, getStoredPayload(checkpoint, save), payload
+			 ))
+			return payload;
+
+		log::error("Failed to read checkpoint {}", checkpoint->m_id);
+	}
+
+	if (checkpoint->m_decoded)
+		return checkpoint->encode();
+	return {};
+}
+
+void ModPlayLayer::loadBlockStore() {
+	if (!m_fields->m_blockStore.isLoaded())
+		m_fields->m_blockStore.load(getBlockStorePath());
+}
+
+// A decoded checkpoint takes about as much memory as its raw payload. Past
+// the budget, the checkpoints restored the longest ago are evicted and decoded
+// again when they're restored. The active checkpoints and the ones that
+// aren't written to the save yet are kept
+void ModPlayLayer::enforceMemoryBudget() {
+	uint64_t budget =
+		Mod::get()->getSettingValue<int64_t>("memory-budget") * 1024 * 1024;
+	if (budget == 0 || m_fields->m_saveBatchDepth > 0)
+		return;
+
+	uint64_t decodedSize = 0;
+	std::vector<PersistentCheckpoint*> evictable;
+	unsigned int index = 0;
+	for (PersistentCheckpoint* checkpoint : m_fields->m_persistentCheckpoints) {
+		index++;
+		if (!checkpoint->m_decoded)
+			continue;
+
+		decodedSize += checkpoint->m_payloadRawSize;
+		if (checkpoint->m_payloadSize != 0 &&
+			 index != m_fields->m_activeCheckpoint &&
+			 index != m_fields->m_ghostActiveCheckpoint)
+			evictable.push_back(checkpoint);
+	}
+
+	if (decodedSize <= budget)
+		return;
+
+	std::sort(
+		evictable.begin(), evictable.end(),
+		[](PersistentCheckpoint* left, PersistentCheckpoint* right) {
+			return left->m_lastRestored < right->m_lastRestored;
+		}
+	);
+
+	for (PersistentCheckpoint* checkpoint : evictable) {
+		if (decodedSize <= budget)
+			break;
+
+		decodedSize -= checkpoint->m_payloadRawSize;
+		checkpoint->evict();
+	}
+}
+
+// Summed up when asked for, stored sizes change whenever the layer is
+// rewritten or its checkpoints are encoded again
+SaveLayerSize ModPlayLayer::getSaveLayerSize() {
+	SaveLayerSize size;
+	size.m_storedSize = m_fields->m_journalSize;
+
+	for (PersistentCheckpoint* checkpoint : m_fields->m_persistentCheckpoints) {
+		if (checkpoint->m_payloadEncoding == PayloadEncoding::Blocks)
+			size.m_storedSize += getCheckpointStoredSize(checkpoint);
+
+		size.m_rawSize += checkpoint->m_payloadRawSize;
+		size.m_memorySize += checkpoint->estimateMemorySize().getTotal();
+	}
+
+	return size;
+}
+
+// Checkpoints in the block store take the size of their blocks
+uint64_t
+ModPlayLayer::getCheckpointStoredSize(PersistentCheckpoint* checkpoint) {
+	if (checkpoint->m_payloadEncoding != PayloadEncoding::Blocks)
+		return checkpoint->m_payloadSize;
+
+	loadBlockStore();
+	return m_fields->m_blockStore.getStoredSize(checkpoint->m_blocks);
+}
+
+// Decoding is still needed for the memory size, the encoded size is only
+// measured the first time
+std::pair<CheckpointSize, CheckpointSize>
+ModPlayLayer::measureCheckpoint(PersistentCheckpoint* checkpoint) {
+	bool decoded = checkpoint->m_decoded;
+	if (!decodePersistentCheckpoint(checkpoint))
+		return {};
+
+	std::pair<CheckpointSize, CheckpointSize> size = {
+		checkpoint->measureEncodedSize(), checkpoint->estimateMemorySize()
+	};
+
+	if (!decoded)
+		checkpoint->evict();
+
+	return size;
+}
+
+void ModPlayLayer::releaseCheckpointBlocks(PersistentCheckpoint* checkpoint) {
+	if (checkpoint->m_payloadEncoding != PayloadEncoding::Blocks)
+		return;
+
+	loadBlockStore();
+	m_fields->m_blockStore.releaseBlocks(checkpoint->m_blocks);
+}
+
+std::vector<char> ModPlayLayer::createSaveHeader() {
+	std::vector<char> header(SAVE_HEADER, SAVE_HEADER + sizeof(SAVE_HEADER));
+
+	appendValue(header, CURRENT_VERSION);
+	appendValue(header, (char)PLATFORM);
+	appendValue(header, CURRENT_LEVEL_HASH);
+
+	if (m_level->m_levelType != GJLevelType::Editor)
+		appendValue(header, m_level->m_levelVersion);
+	else
+		appendValue(header, getLevelIdentifier());
+
+	return header;
+}
+
+// Before the level hash was saved, editor levels used a size_t hash
+uint64_t ModPlayLayer::getSaveHeaderSize(unsigned int saveVersion) {
+	uint64_t headerSize =
+		sizeof(SAVE_HEADER) + sizeof(CURRENT_VERSION) + sizeof(char);
+
+	if (saveVersion >= LEVEL_HASH_VERSION)
+		headerSize += sizeof(LevelHash);
+
+	if (m_level->m_levelType != GJLevelType::Editor)
+		headerSize += sizeof(m_level->m_levelVersion);
+	else if (saveVersion >= LEVEL_HASH_VERSION)
+		headerSize += sizeof(uint64_t);
+	else
+		headerSize += sizeof(size_t);
+
+	return headerSize;
+}
+
+uint64_t ModPlayLayer::getLevelIdentifier(LevelHash hash) {
+	if (m_level->m_levelType != GJLevelType::Editor)
+		return (unsigned int)m_level->m_levelVersion;
+
+	return getLevelFingerprint(m_level, hash);
+}
+
+SaveLayerInfo ModPlayLayer::createSaveLayerInfo() {
+	SaveLayerInfo layerInfo;
+	layerInfo.m_version = CURRENT_VERSION;
+	layerInfo.m_platform = PLATFORM;
+	layerInfo.m_levelIdentifier = getLevelIdentifier();
+	layerInfo.m_checkpointCount = m_fields->m_persistentCheckpoints.count();
+
+	return layerInfo;
 }
 
 void ModPlayLayer::deserializeCheckpoints(bool ignoreVerification) {
 	unloadPersistentCheckpoints();
 	m_fields->m_loadError = LoadError::None;
+	m_fields->m_saveVersion = 0;
+	m_fields->m_nextCheckpointID = 1;
+	m_fields->m_compressionDictionary.clear();
+	m_fields->m_triedTrainingDictionary = false;
+	m_fields->m_saveBaseline.clear();
 
-	std::string savePath = string::pathToString(getSavePath());
-	if (!std::filesystem::exists(savePath))
+	loadSaveContainer();
+	SaveContainer& container = m_fields->m_saveContainer;
+	const ContainerLayer* layer =
+		container.getLayer(m_fields->m_activeSaveLayer);
+	if (layer == nullptr)
 		return;
 
-	persistenceAPI::Stream stream;
-	stream.setFile(savePath, 2);
+	SaveWriter::get()->flush();
+
+	MappedFile containerFile;
+	if (!containerFile.open(container.getPath()))
+		return;
+
+	LayerView save(containerFile, *layer);
+
+	// The header and the old formats are always in the first chunk
+	ByteReader reader(nullptr, 0);
+	if (!layer->m_chunks.empty())
+		reader = save.getChunkReader(layer->m_chunks.front());
 
 	unsigned int saveVersion;
 	std::variant<unsigned int, LoadError> verificationResult =
-		verifySaveStream(stream);
+		verifySaveHeader(reader);
 
 	if (!ignoreVerification) {
 		if (std::holds_alternative<LoadError>(verificationResult)) {
-			stream.end();
-
 			m_fields->m_loadError = std::get<LoadError>(verificationResult);
 
 			return;
@@ -75,141 +909,485 @@ void ModPlayLayer::deserializeCheckpoints(bool ignoreVerification) {
 
 		saveVersion = std::get<unsigned int>(verificationResult);
 	} else {
+		// Forced loads still read the records the way they were written
+		ByteReader headerReader(reader.data(), reader.size());
+		std::optional<SaveHeader> header = readSaveHeader(headerReader);
+
 		saveVersion = CURRENT_VERSION;
+		if (header.has_value() && header->m_version >= 1 &&
+			 header->m_version <= CURRENT_VERSION)
+			saveVersion = header->m_version;
 	}
 
 	removeAllCheckpoints();
 
+	if (saveVersion >= 4) {
+		std::vector<char> damagedRecords;
+		std::vector<JournalEntry> entries = readSaveJournal(
+			save, saveVersion, m_fields->m_compressionDictionary,
+			m_fields->m_saveBaseline, &damagedRecords
+		);
+
+		// Damaged records are kept with a copy of the layer header, so they
+		// can be read on their own
+		if (!damagedRecords.empty()) {
+			damagedRecords.insert(
+				damagedRecords.begin(), reader.data(),
+				reader.data() +
+					std::min(getSaveHeaderSize(saveVersion), reader.size())
+			);
+			quarantineData(
+				container.getQuarantinePath(), damagedRecords.data(),
+				damagedRecords.size()
+			);
+		}
+
+		containerFile.close();
+
+		m_fields->m_journalSize = layer->m_size;
+		m_fields->m_journalLiveSize = 0;
+
+		// Only the metadata is read here, the checkpoint itself is decoded
+		// when it gets restored
+		for (JournalEntry& entry : entries) {
+			PersistentCheckpoint* checkpoint = PersistentCheckpoint::create();
+			checkpoint->m_decoded = false;
+			checkpoint->m_id = entry.m_id;
+			checkpoint->m_objectPos = entry.m_objectPos;
+			checkpoint->m_time = entry.m_time;
+			checkpoint->m_percent = entry.m_percent;
+			checkpoint->m_payloadOffset = entry.m_payloadOffset;
+			checkpoint->m_payloadSize = entry.m_payloadSize;
+			checkpoint->m_payloadEncoding = entry.m_payloadEncoding;
+			checkpoint->m_payloadRawSize = entry.m_payloadRawSize;
+			checkpoint->m_blocks = std::move(entry.m_blocks);
+
+			checkpoint->setupPhysicalObject();
+
+			storePersistentCheckpoint(checkpoint, false);
+
+			m_fields->m_journalLiveSize += getCheckpointRecordSize(checkpoint);
+			m_fields->m_nextCheckpointID =
+				std::max(m_fields->m_nextCheckpointID, entry.m_id + 1);
+		}
+
+		m_fields->m_saveVersion = saveVersion;
+
+		// The intact records are written again on their own, so the damaged
+		// ones are only quarantined once
+		if (!damagedRecords.empty())
+			rewriteDamagedSaveLayer();
+		return;
+	}
+
+	reader.seek(getSaveHeaderSize(saveVersion));
+
 	unsigned int checkpointCount;
-	stream >> checkpointCount;
+	if (!reader.read(checkpointCount)) {
+		m_fields->m_loadError = LoadError::Crash;
+		return;
+	}
+
+	if (saveVersion < 3) {
+		// Old saves have no index, every checkpoint is deserialized through
+		// the stream right away
+		uint64_t payloadOffset =
+			layer->m_chunks.front().m_fileOffset + reader.position();
+		containerFile.close();
 
-	for (unsigned int i = checkpointCount; i > 0; i--) {
-		PersistentCheckpoint* checkpoint = PersistentCheckpoint::create();
+		persistenceAPI::Stream stream;
+		stream.setFile(string::pathToString(container.getPath()), 2);
+		stream.ignore(payloadOffset);
 
-		// try {
-		checkpoint->deserialize(stream, saveVersion);
-		// } catch (...) { // TODO maybe implement exception logging
-		// 	unloadPersistentCheckpoints();
-		// 	log::error("Exception thrown while loading checkpoint");
+		for (unsigned int i = checkpointCount; i > 0; i--) {
+			PersistentCheckpoint* checkpoint = PersistentCheckpoint::create();
 
-		// 	stream.end();
+			// try {
+			checkpoint->deserialize(stream, saveVersion);
+			// } catch (...) { // TODO maybe implement exception logging
+			// 	unloadPersistentCheckpoints();
+			// 	log::error("Exception thrown while loading checkpoint");
 
-		// 	m_fields->m_loadError = LoadError::Crash;
-		// 	return;
-		// }
-		checkpoint->setupPhysicalObject();
+			// 	stream.end();
+
+			// 	m_fields->m_loadError = LoadError::Crash;
+			// 	return;
+			// }
+			checkpoint->setupPhysicalObject();
+
+			storePersistentCheckpoint(checkpoint);
+		}
 
-		storePersistentCheckpoint(checkpoint);
+		stream.end();
+	} else {
+		for (unsigned int i = checkpointCount; i > 0; i--) {
+			PersistentCheckpoint* checkpoint = PersistentCheckpoint::create();
+			checkpoint->m_decoded = false;
+
+			if (!reader.read(checkpoint->m_objectPos) ||
+				 !reader.read(checkpoint->m_time) ||
+				 !reader.read(checkpoint->m_percent) ||
+				 !reader.read(checkpoint->m_payloadOffset) ||
+				 !reader.read(checkpoint->m_payloadSize)) {
+				unloadPersistentCheckpoints();
+				m_fields->m_loadError = LoadError::Crash;
+				return;
+			}
+			checkpoint->m_payloadRawSize = checkpoint->m_payloadSize;
+
+			checkpoint->setupPhysicalObject();
+
+			storePersistentCheckpoint(checkpoint);
+		}
 	}
 
-	stream.end();
+	for (PersistentCheckpoint* checkpoint : m_fields->m_persistentCheckpoints)
+		checkpoint->m_id = m_fields->m_nextCheckpointID++;
+
+	m_fields->m_saveVersion = saveVersion;
 }
 
-void ModPlayLayer::unloadPersistentCheckpoints() {
-	for (PersistentCheckpoint* checkpoint : CCArrayExt<PersistentCheckpoint*>(
-			  m_fields->m_persistentCheckpointArray
-		  )) {
-		checkpoint->m_checkpoint->m_physicalCheckpointObject->removeFromParent();
+// A layer left without checkpoints is kept, so the layers after it don't
+// move
+void ModPlayLayer::rewriteDamagedSaveLayer() {
+	if (m_fields->m_persistentCheckpoints.count() != 0) {
+		serializeCheckpoints();
+		return;
+	}
+
+	std::vector<char> save = createSaveHeader();
+
+	m_fields->m_saveVersion = CURRENT_VERSION;
+	m_fields->m_journalSize = save.size();
+	m_fields->m_journalLiveSize = 0;
+
+	m_fields->m_saveContainer.writeLayer(
+		m_fields->m_activeSaveLayer, std::move(save), createSaveLayerInfo()
+	);
+}
+
+// Replays the journal, checkpoints are inserted the same way they were when
+// they got marked so the order matches the one before the save was closed
+std::vector<JournalEntry> ModPlayLayer::readSaveJournal(
+	const LayerView& save, unsigned int saveVersion,
+	std::vector<char>& dictionary, std::vector<char>& baseline,
+	std::vector<char>* damagedRecords
+) {
+	JournalReplay replay(m_isPlatformer);
+
+	// Records never span chunks, so each chunk is read on its own and damage
+	// in one chunk doesn't affect the others
+	for (const ContainerChunk& chunk : save.getChunks()) {
+		ByteReader reader = save.getChunkReader(chunk);
+		if (chunk.m_layerOffset == 0)
+			reader.seek(getSaveHeaderSize(saveVersion));
+
+		bool intact = readJournalChunk(
+			reader, chunk.m_layerOffset, saveVersion, replay, dictionary,
+			baseline
+		);
+
+		if (!intact && damagedRecords != nullptr)
+			damagedRecords->insert(
+				damagedRecords->end(), reader.data() + reader.position(),
+				reader.data() + reader.size()
+			);
+	}
+
+	return replay.finish();
+}
+
+// Returns false when a record is damaged, the reader is then left at the
+// start of it. Journals from before checksums can only be checked for size
+bool ModPlayLayer::readJournalChunk(
+	ByteReader& reader, uint64_t layerOffset, unsigned int saveVersion,
+	JournalReplay& replay, std::vector<char>& dictionary,
+	std::vector<char>& baseline
+) {
+	bool checksummed = saveVersion >= CHECKSUMMED_RECORDS_VERSION;
+	uint64_t headerSize = checksummed ? RECORD_HEADER_SIZE : RECORD_FRAME_SIZE;
+
+	while (reader.remaining() >= headerSize) {
+		uint64_t recordOffset = reader.position();
+		JournalRecord type;
+		uint64_t size;
+		uint32_t checksum = 0;
+
+		reader.read(type);
+		reader.read(size);
+		if (checksummed)
+			reader.read(checksum);
+
+		if (size > reader.remaining()) {
+			reader.seek(recordOffset);
+			return !checksummed;
+		}
+
+		// Each record is read through its own cursor, so a malformed record
+		// can't make the rest of the journal go out of sync
+		uint64_t bodyOffset = reader.position();
+		ByteReader record(reader.data() + bodyOffset, size);
+		reader.skip(size);
+
+		if (checksummed &&
+			 checksum != getRecordChecksum(
+								 reader.data() + recordOffset, record.data()
+							 )) {
+			reader.seek(recordOffset);
+			return false;
+		}
+
+		switch (type) {
+		case JournalRecord::Checkpoint:
+		case JournalRecord::EncodedCheckpoint: {
+			uint64_t metaSize = CHECKPOINT_META_SIZE;
+
+			JournalEntry entry;
+			entry.m_payloadEncoding = PayloadEncoding::Raw;
+			if (!record.read(entry.m_id) || !record.read(entry.m_objectPos) ||
+				 !record.read(entry.m_time) || !record.read(entry.m_percent))
+				break;
+			if (type == JournalRecord::EncodedCheckpoint) {
+				if (!record.read(entry.m_payloadEncoding) ||
+					 !record.read(entry.m_payloadRawSize))
+					break;
+				metaSize = ENCODED_CHECKPOINT_META_SIZE;
+			}
+			entry.m_payloadOffset = layerOffset + bodyOffset + metaSize;
+			entry.m_payloadSize = size - metaSize;
+			if (type == JournalRecord::Checkpoint)
+				entry.m_payloadRawSize = entry.m_payloadSize;
+
+			if (entry.m_payloadEncoding == PayloadEncoding::Blocks)
+				record.readArray(
+					entry.m_blocks, entry.m_payloadSize / sizeof(uint64_t)
+				);
+
+			replay.add(std::move(entry));
+		} break;
+		case JournalRecord::Remove: {
+			unsigned int id;
+			if (!record.read(id))
+				break;
+
+			replay.remove(id);
+		} break;
+		case JournalRecord::Order: {
+			unsigned int checkpointCount;
+			std::vector<unsigned int> ids;
+			if (!record.read(checkpointCount) ||
+				 !record.readArray(ids, checkpointCount))
+				break;
+
+			replay.order(ids);
+		} break;
+		case JournalRecord::Dictionary:
+			dictionary.assign(record.data(), record.data() + size);
+			break;
+		case JournalRecord::Baseline:
+			baseline.assign(record.data(), record.data() + size);
+			break;
+		default:
+			break;
+		}
 	}
+
+	return !checksummed || reader.remaining() == 0;
+}
+
+void ModPlayLayer::unloadPersistentCheckpoints() {
+	writeSaveBatch();
+
+	// The batch node only holds the checkpoint objects, removing them one by
+	// one searches its children for each of them
+	m_fields->m_persistentCheckpointBatchNode->removeAllChildren();
 	m_fields->m_activeCheckpoint = 0;
 
-	m_fields->m_persistentCheckpointArray->removeAllObjects();
+	m_fields->m_persistentCheckpoints.clear();
+	m_fields->m_decodeBuffer = std::vector<char>();
+	m_fields->m_deltaBuffer = std::vector<char>();
 }
 
-std::variant<unsigned int, LoadError>
-ModPlayLayer::verifySaveStream(persistenceAPI::Stream& stream) {
-	bool isEditorLevel = m_level->m_levelType == GJLevelType::Editor;
+bool ModPlayLayer::decodePersistentCheckpoint(
+	PersistentCheckpoint* checkpoint
+) {
+	if (checkpoint->m_decoded)
+		return true;
 
-	unsigned int saveVersion;
-	char savedPlatform;
-	unsigned int levelVersion;
-	size_t levelStringHash;
-
-	stream.ignore(sizeof(SAVE_HEADER));
-	stream >> saveVersion;
-	stream >> savedPlatform;
-	if (!isEditorLevel) {
-		stream >> levelVersion;
-	} else {
-		stream >> levelStringHash;
+	SaveWriter::get()->flush();
+
+	loadSaveContainer();
+	SaveContainer& container = m_fields->m_saveContainer;
+
+	if (checkpoint->m_payloadEncoding == PayloadEncoding::Raw) {
+		uint64_t payloadOffset = container.getFileOffset(
+			m_fields->m_activeSaveLayer, checkpoint->m_payloadOffset,
+			checkpoint->m_payloadSize
+		);
+		if (payloadOffset == 0) {
+			log::error("Failed to decode checkpoint {}", checkpoint->m_id);
+			return false;
+		}
+
+		checkpoint->decode(
+			string::pathToString(container.getPath()), payloadOffset,
+			m_fields->m_saveVersion
+		);
+		return true;
 	}
 
-	if (saveVersion < 1)
-		return LoadError::OutdatedData;
+	MappedFile containerFile;
+	LayerView save;
+	const ContainerLayer* layer =
+		container.getLayer(m_fields->m_activeSaveLayer);
+	if (checkpoint->m_payloadEncoding != PayloadEncoding::Blocks &&
+		 layer != nullptr && containerFile.open(container.getPath()))
+		save = LayerView(containerFile, *layer);
 
-	if (saveVersion > CURRENT_VERSION)
-		return LoadError::NewData;
+	std::vector<char>& payload = m_fields->m_decodeBuffer;
+	if (!decodeStoredPayload(
+			 checkpoint, getStoredPayload(checkpoint, save), payload
+		 )) {
+		log::error("Failed to decode checkpoint {}", checkpoint->m_id);
+		return false;
+	}
 
-	if (savedPlatform != PLATFORM)
-		return LoadError::OtherPlatform;
+	checkpoint->decode(payload, m_fields->m_saveVersion);
+	return true;
+}
 
-	if (!isEditorLevel) {
-		if (levelVersion != m_level->m_levelVersion)
-			return LoadError::LevelVersionMismatch;
+std::optional<SaveHeader> ModPlayLayer::readSaveHeader(ByteReader& reader) {
+	char name[sizeof(SAVE_HEADER)];
+	SaveHeader header;
+	header.m_levelHash = LevelHash::Std;
+
+	if (!reader.read(name, sizeof(name)) || !reader.read(header.m_version) ||
+		 !reader.read(header.m_platform))
+		return std::nullopt;
+
+	if (header.m_version >= LEVEL_HASH_VERSION &&
+		 !reader.read(header.m_levelHash))
+		return std::nullopt;
+
+	if (m_level->m_levelType != GJLevelType::Editor) {
+		unsigned int levelVersion;
+		if (!reader.read(levelVersion))
+			return std::nullopt;
+		header.m_levelIdentifier = levelVersion;
+	} else if (header.m_version >= LEVEL_HASH_VERSION) {
+		if (!reader.read(header.m_levelIdentifier))
+			return std::nullopt;
 	} else {
-		if (!m_fields->m_levelStringHash.has_value())
-			m_fields->m_levelStringHash = c_stringHasher(m_level->m_levelString);
-		if (levelStringHash != m_fields->m_levelStringHash.value()) {
-			// log::debug(
-			// 	"Bad Level Hash: {} != {}", levelStringHash,
-			// 	m_fields->m_levelStringHash.value()
-			// );
-			return LoadError::LevelVersionMismatch;
-		}
+		size_t levelStringHash;
+		if (!reader.read(levelStringHash))
+			return std::nullopt;
+		header.m_levelIdentifier = levelStringHash;
 	}
 
-	return saveVersion;
+	return header;
 }
 
+// Anything that can't be read is reported as bad data
 std::variant<unsigned int, LoadError>
-ModPlayLayer::verifySavePath(std::filesystem::path path) {
-	if (!std::filesystem::exists(path))
-		return LoadError::None;
+ModPlayLayer::verifySaveHeader(ByteReader& reader) {
+	std::optional<SaveHeader> header = readSaveHeader(reader);
+	if (!header.has_value())
+		return LoadError::Crash;
+
+	if (header->m_version < 1)
+		return LoadError::OutdatedData;
+
+	if (header->m_version > CURRENT_VERSION)
+		return LoadError::NewData;
 
-	persistenceAPI::Stream stream;
-	stream.setFile(string::pathToString(path), 2);
+	if (header->m_platform != PLATFORM)
+		return LoadError::OtherPlatform;
 
-	std::variant<unsigned int, LoadError> result = verifySaveStream(stream);
-	stream.end();
+	// Editor levels are checked with the hash the save was written with
+	if (header->m_levelIdentifier != getLevelIdentifier(header->m_levelHash))
+		return LoadError::LevelVersionMismatch;
 
-	return result;
+	return header->m_version;
 }
 
-std::filesystem::path ModPlayLayer::getSavePath() {
-	std::string savePath = string::pathToString(Mod::get()->getSaveDir());
-	switch (m_level->m_levelType) {
-	case GJLevelType::Editor: {
-		std::string cleanLevelName = m_level->m_levelName;
-		cleanLevelName.erase(
-			std::remove(cleanLevelName.begin(), cleanLevelName.end(), '.'),
-			cleanLevelName.end()
-		);
-		cleanLevelName.erase(
-			std::remove(cleanLevelName.begin(), cleanLevelName.end(), '/'),
-			cleanLevelName.end()
-		);
-		cleanLevelName.erase(
-			std::remove(cleanLevelName.begin(), cleanLevelName.end(), '\\'),
-			cleanLevelName.end()
-		);
-		savePath.append(
-			fmt::format(
-				"/saves/editor/{}-rev{}", cleanLevelName.c_str(),
-				m_level->m_levelRev
-			)
-		);
-	} break;
-	default:
-		savePath.append(
-			fmt::format("/saves/main/{}", m_level->m_levelID.value())
-		);
-		break;
+SaveLayerInfo ModPlayLayer::readSaveLayerInfo(const LayerView& save) {
+	SaveLayerInfo info{};
+	if (save.getChunks().empty())
+		return info;
+
+	ByteReader reader = save.getChunkReader(save.getChunks().front());
+
+	std::optional<SaveHeader> header = readSaveHeader(reader);
+	if (!header.has_value())
+		return info;
+
+	info.m_version = header->m_version;
+	info.m_platform = header->m_platform;
+	info.m_levelIdentifier = header->m_levelIdentifier;
+	if (info.m_version < 4)
+		reader.read(info.m_checkpointCount);
+	else if (info.m_version <= CURRENT_VERSION) {
+		std::vector<char> dictionary;
+		std::vector<char> baseline;
+		info.m_checkpointCount =
+			readSaveJournal(save, info.m_version, dictionary, baseline).size();
 	}
 
-	if (m_lowDetailMode)
-		savePath.append("-lowDetail");
+	return info;
+}
+
+std::filesystem::path ModPlayLayer::getSaveBasePath() {
+	return getLevelSaveBasePath(m_level, m_lowDetailMode);
+}
 
-	savePath.append(fmt::format("_{}.pcp", m_fields->m_activeSaveLayer));
+std::filesystem::path ModPlayLayer::getContainerPath() {
+	std::filesystem::path containerPath = getSaveBasePath();
+	containerPath.concat(".pcpc");
+
+	return containerPath;
+}
+
+std::filesystem::path ModPlayLayer::getLegacySavePath(unsigned int saveLayer) {
+	std::filesystem::path savePath = getSaveBasePath();
+	savePath.concat(fmt::format("_{}.pcp", saveLayer));
 
 	return savePath;
 }
+
+std::filesystem::path ModPlayLayer::getLegacyManifestPath() {
+	std::filesystem::path manifestPath = getSaveBasePath();
+	manifestPath.concat(".pcpm");
+
+	return manifestPath;
+}
+
+std::filesystem::path ModPlayLayer::getBlockStorePath() {
+	std::filesystem::path blockStorePath = getSaveBasePath();
+	blockStorePath.concat(".pcpb");
+
+	return blockStorePath;
+}
+
+std::filesystem::path ModPlayLayer::getStatsLogPath() {
+	std::filesystem::path statsLogPath = getSaveBasePath();
+	statsLogPath.concat(".pcpt");
+
+	return statsLogPath;
+}
+
+// Loaded the first time it's used, most levels are played without looking at
+// the stats
+StatsLog& ModPlayLayer::getStatsLog() {
+	StatsLog& statsLog = m_fields->m_statsLog;
+	if (!statsLog.isLoaded())
+		statsLog.load(getStatsLogPath());
+
+	return statsLog;
+}
+
+const CheckpointStats*
+ModPlayLayer::getCheckpointStats(PersistentCheckpoint* checkpoint) {
+	return getStatsLog().getStats(
+		m_fields->m_activeSaveLayer, checkpoint->m_id
+	);
+}
@@ -1,5 +1,11 @@
 #include "PlayLayer.hpp"
+#include "../Save/SaveArchive.hpp"
+#include "../Save/SaveCatalog.hpp"
+#include "../Save/SavePath.hpp"
+#include "../Save/SaveWriter.hpp"
+#include <algorithm>
 #include <filesystem>
+#include <utility>
 #include <variant>
 
 void ModPlayLayer::nextSaveLayer() {
@@ -25,6 +31,7 @@ void ModPlayLayer::previousSaveLayer() {
 }
 
 void ModPlayLayer::switchCurrentSaveLayer(unsigned int saveLayer) {
+	writeSaveBatch();
 	updateSaveLayerCount();
 
 	m_fields->m_activeSaveLayer =
@@ -34,24 +41,34 @@ void ModPlayLayer::switchCurrentSaveLayer(unsigned int saveLayer) {
 	updateModUI();
 }
 
+// Removing a layer only rewrites the layer table of the container
 void ModPlayLayer::removeCurrentSaveLayer() {
 	unsigned int deletedSaveLayer = m_fields->m_activeSaveLayer;
+	// Unwritten changes to the layer are dropped with it
+	dropPendingCheckpoint();
+	SaveBatch batch = std::exchange(m_fields->m_saveBatch, SaveBatch());
 
-	std::filesystem::path path = getSavePath();
-	if (std::filesystem::exists(path))
-		std::filesystem::remove(path);
-	else
+	loadSaveContainer();
+	SaveContainer& container = m_fields->m_saveContainer;
+	if (deletedSaveLayer >= container.getLayerCount()) {
+		for (PersistentCheckpoint* checkpoint : batch.m_removedCheckpoints)
+			releaseCheckpointBlocks(checkpoint);
 		return;
+	}
 
-	while (true) {
-		m_fields->m_activeSaveLayer++;
-		std::filesystem::path lastPath = path;
-		path = getSavePath();
+	container.removeLayer(deletedSaveLayer);
+	getStatsLog().removeLayer(deletedSaveLayer);
 
-		if (std::filesystem::exists(path))
-			std::filesystem::rename(path, lastPath);
-		else
-			break;
+	for (PersistentCheckpoint* checkpoint : m_fields->m_persistentCheckpoints)
+		releaseCheckpointBlocks(checkpoint);
+	for (PersistentCheckpoint* checkpoint : batch.m_removedCheckpoints)
+		releaseCheckpointBlocks(checkpoint);
+
+	if (container.getLayerCount() == 0) {
+		SaveWriter::get()->flush();
+		std::filesystem::remove(container.getPath());
+		SaveCatalog::get()->updateContainer(container.getPath(), {}, 0);
+		container.clear();
 	}
 
 	if (deletedSaveLayer != 0)
@@ -68,45 +85,259 @@ void ModPlayLayer::swapSaveLayers(unsigned int left, unsigned int right) {
 		 right >= m_fields->m_saveLayerCount)
 		return;
 
-	unsigned int activeSaveLayer = m_fields->m_activeSaveLayer;
+	writeSaveBatch();
+	loadSaveContainer();
+	m_fields->m_saveContainer.swapLayers(left, right);
+	getStatsLog().swapLayers(left, right);
+}
 
-	m_fields->m_activeSaveLayer = left;
-	std::filesystem::path leftPath = getSavePath();
-	if (!std::filesystem::exists(leftPath))
+void ModPlayLayer::updateSaveLayerCount() {
+	loadSaveContainer();
+
+	m_fields->m_saveLayerCount = m_fields->m_saveContainer.getLayerCount();
+	m_fields->m_activeSaveLayer =
+		std::min(m_fields->m_activeSaveLayer, m_fields->m_saveLayerCount);
+}
+
+void ModPlayLayer::loadSaveContainer() {
+	if (m_fields->m_saveContainer.isLoaded())
 		return;
 
-	m_fields->m_activeSaveLayer = right;
-	std::filesystem::path rightPath = getSavePath();
-	if (!std::filesystem::exists(rightPath))
+	// Saves still in the flat layout are moved into their shard when the
+	// level is played before the migration gets to them
+	if (!isShardMigrationDone()) {
+		std::filesystem::path flatBasePath =
+			getFlatLevelSaveBasePath(m_level, m_lowDetailMode);
+		if (moveFlatLevelSaves(flatBasePath, getSaveBasePath()))
+			SaveCatalog::get()->moveLevel(flatBasePath, getSaveBasePath());
+	}
+
+	std::filesystem::path containerPath = getContainerPath();
+	std::filesystem::path archivePath = getLevelArchivePath(getSaveBasePath());
+	bool restored = false;
+	if (!std::filesystem::exists(containerPath) &&
+		 std::filesystem::exists(archivePath)) {
+		restored = restoreLevelSaves(archivePath, getSaveBasePath());
+		if (!restored)
+			log::error("Failed to restore the archived saves of the level");
+	}
+
+	if (!std::filesystem::exists(containerPath)) {
+		migrateLegacySaveLayers();
 		return;
+	}
 
-	std::filesystem::path tempPath = leftPath;
-	tempPath.concat(".temp_move");
+	m_fields->m_saveContainer.load(containerPath);
 
-	std::filesystem::rename(leftPath, tempPath);
-	std::filesystem::rename(rightPath, leftPath);
-	std::filesystem::rename(tempPath, rightPath);
+	// Archived levels aren't in the catalog
+	if (restored) {
+		m_fields->m_saveContainer.updateCatalog();
+
+		std::error_code error;
+		uint64_t blockStoreSize =
+			std::filesystem::file_size(getBlockStorePath(), error);
+		if (!error)
+			SaveCatalog::get()->updateBlockStore(
+				getBlockStorePath(), blockStoreSize
+			);
+	}
 
-	m_fields->m_activeSaveLayer = activeSaveLayer;
+	// Left behind when the game closed during a migration
+	removeLegacySaveLayers();
 }
 
-void ModPlayLayer::updateSaveLayerCount() {
-	unsigned int activeSaveLayer = m_fields->m_activeSaveLayer;
-	m_fields->m_saveLayerCount = 0;
+// Saves from before the container existed have one file per layer, they're
+// moved into the container the first time the level is played
+void ModPlayLayer::migrateLegacySaveLayers() {
+	SaveWriter::get()->flush();
+
+	std::vector<std::vector<char>> layerData;
+	std::vector<SaveLayerInfo> layerInfos;
 
 	while (true) {
-		m_fields->m_activeSaveLayer = m_fields->m_saveLayerCount;
+		MappedFile legacySave;
+		if (!legacySave.open(getLegacySavePath(layerData.size())))
+			break;
+
+		// A legacy file is the layer as a single chunk
+		ContainerLayer layer;
+		layer.m_key = 0;
+		layer.m_chunks.push_back({0, 0, legacySave.size()});
+		layer.m_size = legacySave.size();
+
+		layerInfos.push_back(readSaveLayerInfo(LayerView(legacySave, layer)));
+		layerData.emplace_back(
+			legacySave.data(), legacySave.data() + legacySave.size()
+		);
+	}
+
+	if (layerData.empty()) {
+		m_fields->m_saveContainer.load(getContainerPath());
+		return;
+	}
+
+	m_fields->m_saveContainer.create(
+		getContainerPath(), std::move(layerData), std::move(layerInfos)
+	);
+
+	// The legacy files are only removed once the container is on disk
+	SaveWriter::get()->flush();
+	removeLegacySaveLayers();
+}
 
+void ModPlayLayer::removeLegacySaveLayers() {
+	for (unsigned int i = 0; std::filesystem::exists(getLegacySavePath(i)); i++)
+		std::filesystem::remove(getLegacySavePath(i));
+
+	std::filesystem::remove(getLegacyManifestPath());
+}
+
+void ModPlayLayer::setSaveLayerInfo(
+	unsigned int saveLayer, SaveLayerInfo info
+) {
+	loadSaveContainer();
+	m_fields->m_saveContainer.setLayerInfo(saveLayer, info);
+}
+
+// The current saves are backed up first, so a restore can be undone by
+// restoring the newest backup
+bool ModPlayLayer::restoreBackupLevel(const BackupSnapshot& snapshot) {
+	unloadPersistentCheckpoints();
+	SaveBackup::get()->snapshot();
+
+	if (!SaveBackup::get()->restoreLevel(snapshot, getSaveBasePath())) {
+		deserializeCheckpoints();
+		return false;
+	}
+
+	m_fields->m_saveContainer.clear();
+	m_fields->m_blockStore.clear();
+	m_fields->m_statsLog.clear();
+	m_fields->m_activeSaveLayer = 0;
+
+	updateSaveLayerCount();
+	m_fields->m_saveContainer.updateCatalog();
+
+	std::error_code error;
+	uint64_t blockStoreSize =
+		std::filesystem::file_size(getBlockStorePath(), error);
+	SaveCatalog::get()->updateBlockStore(
+		getBlockStorePath(), error ? 0 : blockStoreSize
+	);
+
+	deserializeCheckpoints();
+	updateModUI();
+	return true;
+}
+
+// The layer is read from a copy of the backed up container and added after
+// the last layer. Checkpoints in the block store can only be restored while
+// the level's store still has their blocks
+bool ModPlayLayer::restoreBackupLayer(
+	const BackupSnapshot& snapshot, unsigned int saveLayer
+) {
+	const BackupFile* file = snapshot.getFile(getContainerPath());
+	std::filesystem::path scratchPath =
+		Mod::get()->getSaveDir() / "restore.pcpc";
+	if (file == nullptr || !SaveBackup::get()->extractFile(*file, scratchPath))
+		return false;
+
+	std::vector<char> layerData;
+	SaveLayerInfo layerInfo;
+	std::vector<uint64_t> blocks;
+	std::vector<unsigned int> ids;
+	bool restorable = false;
+
+	SaveContainer backup;
+	backup.load(scratchPath, true);
+	const ContainerLayer* layer = backup.getLayer(saveLayer);
+
+	MappedFile backupFile;
+	if (layer != nullptr && !layer->m_chunks.empty() &&
+		 backupFile.open(scratchPath)) {
+		LayerView save(backupFile, *layer);
+		ByteReader reader = save.getChunkReader(layer->m_chunks.front());
 		std::variant<unsigned int, LoadError> verificationResult =
-			verifySavePath(getSavePath());
+			verifySaveHeader(reader);
 
-		if (std::holds_alternative<LoadError>(verificationResult) &&
-			 std::get<LoadError>(verificationResult) == LoadError::None)
-			break;
-		else
-			m_fields->m_saveLayerCount++;
+		if (std::holds_alternative<unsigned int>(verificationResult)) {
+			unsigned int saveVersion = std::get<unsigned int>(verificationResult);
+			restorable = true;
+
+			if (saveVersion >= 4) {
+				std::vector<char> dictionary;
+				std::vector<char> baseline;
+				std::vector<JournalEntry> entries =
+					readSaveJournal(save, saveVersion, dictionary, baseline);
+				for (const JournalEntry& entry : entries) {
+					blocks.insert(
+						blocks.end(), entry.m_blocks.begin(), entry.m_blocks.end()
+					);
+					ids.push_back(entry.m_id);
+				}
+
+				loadBlockStore();
+				restorable = m_fields->m_blockStore.hasBlocks(blocks);
+			}
+		}
+
+		if (restorable) {
+			layerData.reserve(layer->m_size);
+			for (const ContainerChunk& chunk : save.getChunks()) {
+				ByteReader chunkReader = save.getChunkReader(chunk);
+				layerData.insert(
+					layerData.end(), chunkReader.data(),
+					chunkReader.data() + chunkReader.size()
+				);
+			}
+			layerInfo = layer->m_info;
+		}
 	}
 
-	m_fields->m_activeSaveLayer =
-		std::min(activeSaveLayer, m_fields->m_saveLayerCount);
+	backupFile.close();
+	std::error_code error;
+	std::filesystem::remove(scratchPath, error);
+
+	if (!restorable)
+		return false;
+
+	writeSaveBatch();
+
+	// The references are written first, a crash in between leaves blocks
+	// nothing uses instead of a layer pointing at released ones
+	m_fields->m_blockStore.retainBlocks(blocks);
+
+	loadSaveContainer();
+	unsigned int restoredLayer = m_fields->m_saveContainer.getLayerCount();
+	m_fields->m_saveContainer.writeLayer(
+		restoredLayer, std::move(layerData), layerInfo
+	);
+
+	restoreBackupStats(snapshot, saveLayer, restoredLayer, ids);
+
+	switchCurrentSaveLayer(restoredLayer);
+	return true;
+}
+
+// Stats of the restored checkpoints are read from the backed up log and kept
+// under the layer the checkpoints were restored to
+void ModPlayLayer::restoreBackupStats(
+	const BackupSnapshot& snapshot, unsigned int saveLayer,
+	unsigned int restoredLayer, const std::vector<unsigned int>& ids
+) {
+	const BackupFile* file = snapshot.getFile(getStatsLogPath());
+	std::filesystem::path scratchPath =
+		Mod::get()->getSaveDir() / "restore.pcpt";
+	if (file == nullptr || !SaveBackup::get()->extractFile(*file, scratchPath))
+		return;
+
+	StatsLog backupStats;
+	backupStats.load(scratchPath, true);
+
+	for (unsigned int id : ids)
+		if (const CheckpointStats* stats = backupStats.getStats(saveLayer, id))
+			getStatsLog().setStats(restoredLayer, id, *stats);
+
+	std::error_code error;
+	std::filesystem::remove(scratchPath, error);
 }
@@ -107,7 +107,7 @@ void ModUILayer::updateSwitcher() {
 
 	m_fields->m_switcherMenu->setVisible(
 		playLayer->m_isPracticeMode &&
-		(playLayer->m_fields->m_persistentCheckpointArray->count() > 0 ||
+		(playLayer->m_fields->m_persistentCheckpoints.count() > 0 ||
 		 playLayer->m_fields->m_activeSaveLayer > 0 ||
 		 loadError != LoadError::None)
 	);
@@ -129,7 +129,7 @@ void ModUILayer::updateSwitcher() {
 		checkpointString = fmt::format(
 			"{}{}/{}", playLayer->m_fields->m_activeCheckpoint,
 			ghostCheckpointString,
-			playLayer->m_fields->m_persistentCheckpointArray->count()
+			playLayer->m_fields->m_persistentCheckpoints.count()
 		);
 		break;
 	}
@@ -1,4 +1,5 @@
 #include "PersistentCheckpoint.hpp"
+#include "Save/FieldTable.hpp"
 
 #include <Geode/binding/CheckpointObject.hpp>
 #include <Geode/binding/GameObject.hpp>
@@ -14,8 +15,40 @@
 #include <sabe.persistenceapi/include/hooks/cocos2d/CCNode.hpp>
 #include <sabe.persistenceapi/include/util/Stream.hpp>
 
+#include <fstream>
+
 using namespace persistenceAPI;
 
+// Layout of the fields that aren't saved by the API hooks, serialize and
+// deserialize both go through these tables
+
+// Written after the player checkpoints
+using CheckpointStateFields = FieldTable<
+	FieldRun<
+		&CheckpointObject::m_unke78, &CheckpointObject::m_unke7c,
+		&CheckpointObject::m_unke80, &CheckpointObject::m_ground2Invisible,
+		&CheckpointObject::m_streakBlend, &CheckpointObject::m_uniqueID,
+		&CheckpointObject::m_respawnID>,
+	StreamedFields<
+		&CheckpointObject::m_vectorSavedObjectStateRef,
+		&CheckpointObject::m_vectorActiveSaveObjectState,
+		&CheckpointObject::m_vectorSpecialSaveObjectState>>;
+
+// Written after the effect manager state and the gradients
+using CheckpointTriggerFields = FieldTable<
+	FieldRun<&CheckpointObject::m_unk11e8>,
+	StreamedFields<&CheckpointObject::m_sequenceTriggerStateUnorderedMap>,
+	FieldRun<&CheckpointObject::m_commandIndex>>;
+
+// Custom data, saves from version 1 have an unused int after the position
+using CheckpointPositionFields =
+	FieldTable<StreamedFields<&PersistentCheckpoint::m_objectPos>>;
+using CheckpointProgressFields = FieldTable<
+	FieldRun<&PersistentCheckpoint::m_time, &PersistentCheckpoint::m_percent>,
+	StreamedFields<
+		&PersistentCheckpoint::m_persistentItemCountMap,
+		&PersistentCheckpoint::m_persistentTimerItemSet>>;
+
 PersistentCheckpoint* PersistentCheckpoint::create() {
 	PersistentCheckpoint* checkpoint = new PersistentCheckpoint();
 	checkpoint->m_checkpoint = CheckpointObject::create();
@@ -52,51 +85,60 @@ PersistentCheckpoint* PersistentCheckpoint::createFromCheckpoint(
 }
 
 void PersistentCheckpoint::serialize(Stream& out) {
-	reinterpret_cast<PACCNode*>(m_checkpoint.data())->save(out);
+	for (unsigned int i = 0; i < CHECKPOINT_SECTION_COUNT; i++)
+		serializeSection(out, (CheckpointSection)i);
+}
 
+void PersistentCheckpoint::serializeSection(
+	Stream& out, CheckpointSection section
+) {
 	bool hasP2 = m_checkpoint->m_player2Checkpoint != nullptr;
 	bool hasGradients = m_checkpoint->m_gradientTriggerObjectArray != nullptr;
 
-	out << hasP2;
-	out << hasGradients;
+	switch (section) {
+	case CheckpointSection::GameState:
+		reinterpret_cast<PACCNode*>(m_checkpoint.data())->save(out);
 
-	reinterpret_cast<PAGJGameState*>(&m_checkpoint->m_gameState)->save(out);
-	reinterpret_cast<PAGJShaderState*>(&m_checkpoint->m_shaderState)->save(out);
-	reinterpret_cast<PAFMODAudioState*>(&m_checkpoint->m_audioState)->save(out);
+		out << hasP2;
+		out << hasGradients;
 
-	reinterpret_cast<PAPlayerCheckpoint*>(m_checkpoint->m_player1Checkpoint)
-		->save(out);
-	if (hasP2)
-		reinterpret_cast<PAPlayerCheckpoint*>(m_checkpoint->m_player2Checkpoint)
+		reinterpret_cast<PAGJGameState*>(&m_checkpoint->m_gameState)->save(out);
+		reinterpret_cast<PAGJShaderState*>(&m_checkpoint->m_shaderState)
 			->save(out);
-
-	out << m_checkpoint->m_unke78;
-	out << m_checkpoint->m_unke7c;
-	out << m_checkpoint->m_unke80;
-	out << m_checkpoint->m_ground2Invisible;
-	out << m_checkpoint->m_streakBlend;
-	out << m_checkpoint->m_uniqueID;
-	out << m_checkpoint->m_respawnID;
-	out << m_checkpoint->m_vectorSavedObjectStateRef;
-	out << m_checkpoint->m_vectorActiveSaveObjectState;
-	out << m_checkpoint->m_vectorSpecialSaveObjectState;
-
-	reinterpret_cast<PAEffectManagerState*>(&m_checkpoint->m_effectManagerState)
-		->save(out);
-	if (hasGradients)
-		static_cast<PACCArray*>(m_checkpoint->m_gradientTriggerObjectArray)
-			->save<GradientTriggerObject>(out);
-
-	out << m_checkpoint->m_unk11e8;
-	out << m_checkpoint->m_sequenceTriggerStateUnorderedMap;
-	out << m_checkpoint->m_commandIndex;
-
-	// Custom data
-	out << m_objectPos;
-	out << m_time;
-	out << m_percent;
-	out << m_persistentItemCountMap;
-	out << m_persistentTimerItemSet;
+		reinterpret_cast<PAFMODAudioState*>(&m_checkpoint->m_audioState)
+			->save(out);
+		break;
+	case CheckpointSection::Players:
+		reinterpret_cast<PAPlayerCheckpoint*>(m_checkpoint->m_player1Checkpoint)
+			->save(out);
+		if (hasP2)
+			reinterpret_cast<PAPlayerCheckpoint*>(
+				m_checkpoint->m_player2Checkpoint
+			)
+				->save(out);
+		break;
+	case CheckpointSection::ObjectStates:
+		CheckpointStateFields::save(out, *m_checkpoint.data());
+		break;
+	case CheckpointSection::EffectManager:
+		reinterpret_cast<PAEffectManagerState*>(
+			&m_checkpoint->m_effectManagerState
+		)
+			->save(out);
+		break;
+	case CheckpointSection::Gradients:
+		if (hasGradients)
+			static_cast<PACCArray*>(m_checkpoint->m_gradientTriggerObjectArray)
+				->save<GradientTriggerObject>(out);
+		break;
+	case CheckpointSection::SequenceTriggers:
+		CheckpointTriggerFields::save(out, *m_checkpoint.data());
+		break;
+	case CheckpointSection::Progress:
+		CheckpointPositionFields::save(out, *this);
+		CheckpointProgressFields::save(out, *this);
+		break;
+	}
 }
 
 void PersistentCheckpoint::deserialize(Stream& in, unsigned int saveVersion) {
@@ -132,16 +174,7 @@ void PersistentCheckpoint::deserialize(Stream& in, unsigned int saveVersion) {
 
 	// geode::log::debug("checkpoints");
 
-	in >> m_checkpoint->m_unke78;
-	in >> m_checkpoint->m_unke7c;
-	in >> m_checkpoint->m_unke80;
-	in >> m_checkpoint->m_ground2Invisible;
-	in >> m_checkpoint->m_streakBlend;
-	in >> m_checkpoint->m_uniqueID;
-	in >> m_checkpoint->m_respawnID;
-	in >> m_checkpoint->m_vectorSavedObjectStateRef;
-	in >> m_checkpoint->m_vectorActiveSaveObjectState;
-	in >> m_checkpoint->m_vectorSpecialSaveObjectState;
+	CheckpointStateFields::load(in, *m_checkpoint.data());
 
 	// geode::log::debug("vars");
 
@@ -157,23 +190,152 @@ void PersistentCheckpoint::deserialize(Stream& in, unsigned int saveVersion) {
 
 	// geode::log::debug("gradients {}", hasGradients);
 
-	in >> m_checkpoint->m_unk11e8;
-	in >> m_checkpoint->m_sequenceTriggerStateUnorderedMap;
-	in >> m_checkpoint->m_commandIndex;
+	CheckpointTriggerFields::load(in, *m_checkpoint.data());
 
-	// Custom data
-	in >> m_objectPos;
+	CheckpointPositionFields::load(in, *this);
 	if (saveVersion <= 1) {
 		in.ignore(sizeof(int));
 	}
-	in >> m_time;
-	in >> m_percent;
-	in >> m_persistentItemCountMap;
-	in >> m_persistentTimerItemSet;
+	CheckpointProgressFields::load(in, *this);
 
 	// geode::log::debug("eof {}", m_commandIndex);
 }
 
+// The stream can only write to files, so the checkpoint is encoded into a
+// scratch file and read back to get its bytes
+std::vector<char> PersistentCheckpoint::encode() {
+	std::string scratchPath =
+		string::pathToString(Mod::get()->getSaveDir() / "encode.tmp");
+
+	Stream stream;
+	stream.setFile(scratchPath, 2, true);
+	serialize(stream);
+	stream.end();
+
+	std::ifstream file(scratchPath, std::ios::binary | std::ios::ate);
+	std::vector<char> payload(file.tellg());
+	file.seekg(0);
+	file.read(payload.data(), payload.size());
+
+	return payload;
+}
+
+// Each section is encoded on its own into the scratch file
+CheckpointSize PersistentCheckpoint::measureEncodedSize() {
+	if (m_encodedSize.has_value())
+		return m_encodedSize.value();
+
+	CheckpointSize size;
+	if (!m_decoded)
+		return size;
+
+	std::filesystem::path scratchPath =
+		Mod::get()->getSaveDir() / "measure.tmp";
+
+	for (unsigned int i = 0; i < CHECKPOINT_SECTION_COUNT; i++) {
+		Stream stream;
+		stream.setFile(string::pathToString(scratchPath), 2, true);
+		serializeSection(stream, (CheckpointSection)i);
+		stream.end();
+
+		std::error_code error;
+		uint64_t sectionSize = std::filesystem::file_size(scratchPath, error);
+		size.m_sections[i] = error ? 0 : sectionSize;
+	}
+
+	m_encodedSize = size;
+	return size;
+}
+
+// Counts the objects and containers the mod can see, containers inside the
+// game's state structs aren't followed
+CheckpointSize PersistentCheckpoint::estimateMemorySize() {
+	CheckpointSize size;
+	if (!m_decoded)
+		return size;
+
+	// Hash containers also allocate a node and a bucket for every entry
+	auto getHashedSize = [](const auto& container) {
+		using Value = typename std::decay_t<decltype(container)>::value_type;
+		return container.size() * (sizeof(Value) + 3 * sizeof(void*));
+	};
+	auto getVectorSize = [](const auto& vector) {
+		using Value = typename std::decay_t<decltype(vector)>::value_type;
+		return vector.capacity() * sizeof(Value);
+	};
+
+	size[CheckpointSection::GameState] = sizeof(CheckpointObject);
+
+	size[CheckpointSection::Players] = sizeof(PlayerCheckpoint);
+	if (m_checkpoint->m_player2Checkpoint != nullptr)
+		size[CheckpointSection::Players] += sizeof(PlayerCheckpoint);
+
+	size[CheckpointSection::ObjectStates] =
+		getVectorSize(m_checkpoint->m_vectorSavedObjectStateRef) +
+		getVectorSize(m_checkpoint->m_vectorActiveSaveObjectState) +
+		getVectorSize(m_checkpoint->m_vectorSpecialSaveObjectState);
+
+	if (m_checkpoint->m_gradientTriggerObjectArray != nullptr)
+		size[CheckpointSection::Gradients] =
+			sizeof(CCArray) +
+			m_checkpoint->m_gradientTriggerObjectArray->count() *
+				(sizeof(GradientTriggerObject) + sizeof(void*));
+
+	size[CheckpointSection::SequenceTriggers] =
+		getHashedSize(m_checkpoint->m_sequenceTriggerStateUnorderedMap);
+
+	size[CheckpointSection::Progress] =
+		sizeof(PersistentCheckpoint) + getHashedSize(m_persistentItemCountMap) +
+		getHashedSize(m_persistentTimerItemSet);
+
+	return size;
+}
+
+void PersistentCheckpoint::decode(
+	const std::string& path, uint64_t offset, unsigned int saveVersion
+) {
+	if (m_decoded)
+		return;
+
+	Stream stream;
+	stream.setFile(path, 2);
+	stream.ignore(offset);
+
+	deserialize(stream, saveVersion);
+
+	stream.end();
+	m_decoded = true;
+}
+
+// Same as encoding, the payload goes through a scratch file so the stream
+// can read it
+void PersistentCheckpoint::decode(
+	const std::vector<char>& payload, unsigned int saveVersion
+) {
+	std::string scratchPath =
+		string::pathToString(Mod::get()->getSaveDir() / "decode.tmp");
+
+	std::ofstream file(scratchPath, std::ios::binary | std::ios::trunc);
+	file.write(payload.data(), payload.size());
+	file.close();
+
+	decode(scratchPath, 0, saveVersion);
+}
+
+void PersistentCheckpoint::evict() {
+	if (!m_decoded)
+		return;
+
+	// The object layer keeps it alive once it's placed
+	Ref<GameObject> physicalObject = m_checkpoint->m_physicalCheckpointObject;
+	m_checkpoint = CheckpointObject::create();
+	m_checkpoint->m_physicalCheckpointObject = physicalObject;
+
+	m_persistentItemCountMap.clear();
+	m_persistentTimerItemSet.clear();
+	m_decoded = false;
+}
+
 void PersistentCheckpoint::setupPhysicalObject() {
 	if (m_checkpoint->m_physicalCheckpointObject == nullptr)
 		m_checkpoint->m_physicalCheckpointObject =
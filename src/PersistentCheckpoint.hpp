@@ -1,8 +1,13 @@
 #pragma once
+#include "Save/CheckpointSize.hpp"
+#include "Save/Compression.hpp"
+
 #include <Geode/binding/CheckpointObject.hpp>
 #include <Geode/modify/CheckpointObject.hpp>
 
 #include <sabe.persistenceapi/include/util/Stream.hpp>
+#include <optional>
+#include <vector>
 
 using namespace geode::prelude;
 
@@ -14,6 +19,27 @@ public:
 	double m_percent;
 	gd::unordered_map<int, int> m_persistentItemCountMap;
 	gd::unordered_set<int> m_persistentTimerItemSet;
+	// Stays the same when checkpoints are reordered, save records use it to
+	// refer to the checkpoint
+	unsigned int m_id = 0;
+
+	// Where the encoded checkpoint lives in the save file, a size of 0 means
+	// that it hasn't been written yet
+	uint64_t m_payloadOffset = 0;
+	uint64_t m_payloadSize = 0;
+	PayloadEncoding m_payloadEncoding = PayloadEncoding::Raw;
+	uint64_t m_payloadRawSize = 0;
+	// Hashes of the payload blocks when it's in the block store
+	std::vector<uint64_t> m_blocks;
+	// Checkpoints read from an indexed save only have their metadata loaded,
+	// the rest is decoded when they're first restored
+	bool m_decoded = true;
+	// When the checkpoint was last restored, the decoded checkpoints restored
+	// the longest ago are evicted first
+	uint64_t m_lastRestored = 0;
+	// The payload never changes once the checkpoint is made, so it's only
+	// measured once and kept when the checkpoint is evicted
+	std::optional<CheckpointSize> m_encodedSize;
 
 	static PersistentCheckpoint* create();
 	static PersistentCheckpoint* createFromCheckpoint(
@@ -23,7 +49,21 @@ public:
 	);
 
 	void serialize(persistenceAPI::Stream& out);
+	void serializeSection(
+		persistenceAPI::Stream& out, CheckpointSection section
+	);
 	void deserialize(persistenceAPI::Stream& in, unsigned int saveVersion);
+	std::vector<char> encode();
+	void
+	decode(const std::string& path, uint64_t offset, unsigned int saveVersion);
+	void decode(const std::vector<char>& payload, unsigned int saveVersion);
+	// Both are empty when the checkpoint isn't decoded and wasn't measured
+	// before
+	CheckpointSize measureEncodedSize();
+	CheckpointSize estimateMemorySize();
+	// Drops the decoded checkpoint, only what's needed to show the checkpoint
+	// and decode it again is kept
+	void evict();
 	void setupPhysicalObject();
 	void toggleActive(bool);
 };
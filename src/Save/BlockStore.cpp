@@ -0,0 +1,441 @@
+#include "BlockStore.hpp"
+#include "ByteBuffer.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Quarantine.hpp"
+#include "SaveCatalog.hpp"
+#include "SaveJournal.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+using namespace geode::prelude;
+
+const char BLOCK_STORE_HEADER[] = "PCP BLOCKS";
+const unsigned int BLOCK_STORE_VERSION = 2;
+// Since version 2 records have the same header as journal records, with a
+// checksum of the frame and the body
+const unsigned int CHECKSUMMED_BLOCKS_VERSION = 2;
+
+enum class BlockRecord : char {
+	Block = 1,
+	References = 2,
+};
+static_assert(sizeof(BlockRecord) == sizeof(JournalRecord));
+
+// Hash, encoding, raw size and stored size
+const uint64_t BLOCK_META_SIZE = sizeof(uint64_t) + sizeof(PayloadEncoding) +
+											sizeof(uint64_t) + sizeof(uint64_t);
+
+// Block boundaries depend on the content (FastCDC style gear hashing), so
+// data that moves inside the payload still produces the same blocks
+const uint64_t MIN_BLOCK_SIZE = 2 * 1024;
+const uint64_t MAX_BLOCK_SIZE = 64 * 1024;
+const uint64_t BLOCK_BOUNDARY_MASK = 8 * 1024 - 1;
+
+const uint64_t MIN_BLOCK_STORE_SLACK = 1024 * 1024;
+
+static const std::array<uint64_t, 256> c_gearTable = [] {
+	std::array<uint64_t, 256> table;
+
+	// splitmix64, the table only has to be the same on every run
+	uint64_t state = 0;
+	for (uint64_t& value : table) {
+		state += 0x9E3779B97F4A7C15ull;
+		uint64_t mixed = state;
+		mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ull;
+		mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBull;
+		value = mixed ^ (mixed >> 31);
+	}
+
+	return table;
+}();
+
+// The body size and checksum are filled in by endRecord once the body is
+// written
+static uint64_t beginRecord(std::vector<char>& buffer, BlockRecord type) {
+	uint64_t recordOffset = buffer.size();
+	appendValue(buffer, type);
+	buffer.resize(buffer.size() + RECORD_HEADER_SIZE - sizeof(type));
+
+	return recordOffset;
+}
+
+static uint64_t findBlockEnd(const char* data, uint64_t size) {
+	if (size <= MIN_BLOCK_SIZE)
+		return size;
+
+	uint64_t limit = std::min(size, MAX_BLOCK_SIZE);
+	uint64_t fingerprint = 0;
+
+	for (uint64_t position = MIN_BLOCK_SIZE; position < limit; position++) {
+		fingerprint = (fingerprint << 1) +
+						  c_gearTable[static_cast<unsigned char>(data[position])];
+		if ((fingerprint & BLOCK_BOUNDARY_MASK) == 0)
+			return position + 1;
+	}
+
+	return limit;
+}
+
+void BlockStore::load(const std::filesystem::path& path) {
+	clear();
+	m_path = path;
+
+	SaveWriter::get()->flush();
+
+	MappedFile store;
+	if (!store.open(path))
+		return;
+
+	ByteReader reader = store.reader();
+
+	char header[sizeof(BLOCK_STORE_HEADER)];
+	unsigned int version;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version) ||
+		 std::memcmp(header, BLOCK_STORE_HEADER, sizeof(header)) != 0 ||
+		 version > BLOCK_STORE_VERSION) {
+		log::error("Invalid block store {}", string::pathToString(path));
+		m_readOnly = true;
+		return;
+	}
+
+	bool checksummed = version >= CHECKSUMMED_BLOCKS_VERSION;
+	uint64_t headerSize = checksummed ? RECORD_HEADER_SIZE : RECORD_FRAME_SIZE;
+
+	uint64_t position = reader.position();
+	while (reader.remaining() >= headerSize) {
+		BlockRecord type;
+		uint64_t size;
+		uint32_t checksum = 0;
+		reader.read(type);
+		reader.read(size);
+		if (checksummed)
+			reader.read(checksum);
+
+		if (size > reader.remaining())
+			break;
+
+		uint64_t bodyOffset = reader.position();
+		ByteReader record(reader.data() + bodyOffset, size);
+		reader.skip(size);
+
+		if (checksummed &&
+			 checksum !=
+				 getRecordChecksum(store.data() + position, record.data()))
+			break;
+
+		switch (type) {
+		case BlockRecord::Block: {
+			uint64_t hash;
+			StoredBlock block;
+			if (!record.read(hash) || !record.read(block.m_encoding) ||
+				 !record.read(block.m_rawSize) ||
+				 !record.read(block.m_storedSize) ||
+				 block.m_storedSize != record.remaining())
+				break;
+			block.m_offset = bodyOffset + BLOCK_META_SIZE;
+
+			m_blocks[hash] = block;
+		} break;
+		case BlockRecord::References: {
+			uint64_t hash;
+			int change;
+			while (record.read(hash) && record.read(change)) {
+				auto block = m_blocks.find(hash);
+				if (block != m_blocks.end() &&
+					 (change > 0 || block->second.m_references > 0))
+					block->second.m_references += change;
+			}
+		} break;
+		default:
+			break;
+		}
+
+		position = reader.position();
+	}
+
+	// A record that was cut short by a crash or damaged on disk ends the
+	// store. Everything from there is kept aside and cut off, so new records
+	// don't end up after it
+	uint64_t storeSize = store.size();
+	if (position < storeSize) {
+		std::filesystem::path quarantinePath = path;
+		quarantinePath.replace_extension(".pcpq");
+		quarantineData(
+			quarantinePath, store.data() + position, storeSize - position
+		);
+	}
+
+	store.close();
+
+	if (position < storeSize) {
+		SaveWriter::get()->flush();
+		std::filesystem::resize_file(path, position);
+	}
+
+	m_size = position;
+	for (auto& [hash, block] : m_blocks)
+		if (block.m_references > 0)
+			m_liveSize +=
+				RECORD_HEADER_SIZE + BLOCK_META_SIZE + block.m_storedSize;
+
+	if (version < BLOCK_STORE_VERSION)
+		compact();
+}
+
+bool BlockStore::isLoaded() { return !m_path.empty(); }
+
+void BlockStore::clear() {
+	m_path.clear();
+	m_blocks.clear();
+	m_size = 0;
+	m_liveSize = 0;
+	m_readOnly = false;
+	m_blockBuffer = std::vector<char>();
+}
+
+std::optional<std::vector<uint64_t>> BlockStore::storePayload(
+	const std::vector<char>& payload, CompressionLevel level
+) {
+	if (m_readOnly)
+		return std::nullopt;
+
+	std::vector<uint64_t> hashes;
+	bool collision = false;
+	std::vector<char> records;
+
+	if (m_size == 0) {
+		records.insert(
+			records.end(), BLOCK_STORE_HEADER,
+			BLOCK_STORE_HEADER + sizeof(BLOCK_STORE_HEADER)
+		);
+		appendValue(records, BLOCK_STORE_VERSION);
+	}
+
+	uint64_t position = 0;
+	while (position < payload.size()) {
+		const char* data = payload.data() + position;
+		uint64_t size = findBlockEnd(data, payload.size() - position);
+		uint64_t hash = hashBytes(data, size);
+		position += size;
+
+		hashes.push_back(hash);
+
+		auto stored = m_blocks.find(hash);
+		if (stored != m_blocks.end()) {
+			if (stored->second.m_rawSize != size) {
+				collision = true;
+				break;
+			}
+			continue;
+		}
+
+		StoredBlock block;
+		block.m_rawSize = size;
+		block.m_encoding = PayloadEncoding::Raw;
+
+		std::vector<char> compressedBlock;
+		if (level != CompressionLevel::None)
+			compressedBlock = compressPayload(data, size, {}, level);
+
+		if (!compressedBlock.empty() && compressedBlock.size() < size) {
+			block.m_encoding = PayloadEncoding::LZ;
+			data = compressedBlock.data();
+			block.m_storedSize = compressedBlock.size();
+		} else
+			block.m_storedSize = size;
+
+		uint64_t recordOffset = beginRecord(records, BlockRecord::Block);
+		appendValue(records, hash);
+		appendValue(records, block.m_encoding);
+		appendValue(records, block.m_rawSize);
+		appendValue(records, block.m_storedSize);
+
+		block.m_offset = m_size + records.size();
+		records.insert(records.end(), data, data + block.m_storedSize);
+		endRecord(records, recordOffset);
+
+		m_blocks[hash] = block;
+	}
+
+	// Blocks written before a collision are left unreferenced and get removed
+	// on the next compaction
+	m_size += records.size();
+	SaveWriter::get()->append(m_path, std::move(records));
+
+	if (collision)
+		return std::nullopt;
+
+	retainBlocks(hashes);
+
+	return hashes;
+}
+
+bool BlockStore::hasBlocks(const std::vector<uint64_t>& hashes) {
+	return std::all_of(hashes.begin(), hashes.end(), [this](uint64_t hash) {
+		return m_blocks.contains(hash);
+	});
+}
+
+uint64_t BlockStore::getStoredSize(const std::vector<uint64_t>& hashes) {
+	uint64_t size = 0;
+	for (uint64_t hash : hashes) {
+		auto stored = m_blocks.find(hash);
+		if (stored != m_blocks.end())
+			size += stored->second.m_storedSize;
+	}
+
+	return size;
+}
+
+void BlockStore::retainBlocks(const std::vector<uint64_t>& hashes) {
+	changeReferences(hashes, 1);
+}
+
+void BlockStore::releaseBlocks(const std::vector<uint64_t>& hashes) {
+	changeReferences(hashes, -1);
+
+	uint64_t slack = m_size - m_liveSize;
+	if (slack > std::max(m_liveSize, MIN_BLOCK_STORE_SLACK))
+		compact();
+}
+
+bool BlockStore::readPayload(
+	const std::vector<uint64_t>& hashes, uint64_t rawSize,
+	std::vector<char>& payload
+) {
+	SaveWriter::get()->flush();
+
+	MappedFile store;
+	if (!store.open(m_path))
+		return false;
+
+	payload.clear();
+	payload.reserve(rawSize);
+
+	for (uint64_t hash : hashes) {
+		auto stored = m_blocks.find(hash);
+		if (stored == m_blocks.end())
+			return false;
+
+		const StoredBlock& block = stored->second;
+		if (block.m_offset > store.size() ||
+			 block.m_storedSize > store.size() - block.m_offset)
+			return false;
+
+		const char* storedBlock = store.data() + block.m_offset;
+
+		if (block.m_encoding == PayloadEncoding::Raw) {
+			payload.insert(
+				payload.end(), storedBlock, storedBlock + block.m_storedSize
+			);
+			continue;
+		}
+
+		if (!decompressPayload(
+				 storedBlock, block.m_storedSize, {}, m_blockBuffer,
+				 block.m_rawSize
+			 ))
+			return false;
+
+		payload.insert(payload.end(), m_blockBuffer.begin(), m_blockBuffer.end());
+	}
+
+	return payload.size() == rawSize;
+}
+
+void BlockStore::changeReferences(
+	const std::vector<uint64_t>& hashes, int change
+) {
+	if (m_readOnly || hashes.empty())
+		return;
+
+	std::vector<char> record;
+	uint64_t recordOffset = beginRecord(record, BlockRecord::References);
+
+	for (uint64_t hash : hashes) {
+		appendValue(record, hash);
+		appendValue(record, change);
+
+		auto stored = m_blocks.find(hash);
+		if (stored == m_blocks.end())
+			continue;
+
+		StoredBlock& block = stored->second;
+		uint64_t blockSize =
+			RECORD_HEADER_SIZE + BLOCK_META_SIZE + block.m_storedSize;
+
+		if (block.m_references == 0) {
+			if (change < 0)
+				continue;
+			m_liveSize += blockSize;
+		}
+
+		block.m_references += change;
+		if (block.m_references == 0)
+			m_liveSize -= blockSize;
+	}
+
+	endRecord(record, recordOffset);
+
+	m_size += record.size();
+	SaveWriter::get()->append(m_path, std::move(record));
+
+	SaveCatalog::get()->updateBlockStore(m_path, m_size);
+}
+
+// Rewrites the store without the blocks nothing references anymore
+void BlockStore::compact() {
+	SaveWriter::get()->flush();
+
+	MappedFile previousStore;
+	if (!previousStore.open(m_path))
+		return;
+
+	std::vector<char> store(
+		BLOCK_STORE_HEADER, BLOCK_STORE_HEADER + sizeof(BLOCK_STORE_HEADER)
+	);
+	appendValue(store, BLOCK_STORE_VERSION);
+
+	std::vector<char> references;
+	std::erase_if(m_blocks, [&previousStore](const auto& block) {
+		return block.second.m_references == 0 ||
+				 block.second.m_offset > previousStore.size() ||
+				 block.second.m_storedSize >
+					 previousStore.size() - block.second.m_offset;
+	});
+
+	for (auto& [hash, block] : m_blocks) {
+		uint64_t recordOffset = beginRecord(store, BlockRecord::Block);
+		appendValue(store, hash);
+		appendValue(store, block.m_encoding);
+		appendValue(store, block.m_rawSize);
+		appendValue(store, block.m_storedSize);
+
+		const char* data = previousStore.data() + block.m_offset;
+		block.m_offset = store.size();
+		store.insert(store.end(), data, data + block.m_storedSize);
+		endRecord(store, recordOffset);
+
+		appendValue(references, hash);
+		appendValue(references, (int)block.m_references);
+	}
+
+	uint64_t recordOffset = beginRecord(store, BlockRecord::References);
+	store.insert(store.end(), references.begin(), references.end());
+	endRecord(store, recordOffset);
+
+	previousStore.close();
+
+	m_size = store.size();
+	m_liveSize = store.size();
+
+	SaveWriter::get()->write(m_path, std::move(store));
+
+	SaveCatalog::get()->updateBlockStore(m_path, m_size);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "Compression.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct StoredBlock {
+	uint64_t m_offset;
+	uint64_t m_storedSize;
+	uint64_t m_rawSize;
+	PayloadEncoding m_encoding;
+	unsigned int m_references = 0;
+};
+
+// Per level store of checkpoint payload blocks, identical blocks from any
+// checkpoint or layer are only stored once. The file is a journal of new
+// blocks and reference count changes
+class BlockStore {
+public:
+	void load(const std::filesystem::path& path);
+	bool isLoaded();
+	// Forgets every block, for when the store file was deleted
+	void clear();
+
+	// Splits the payload into blocks, writes the ones that aren't stored yet
+	// and adds a reference to each of them
+	std::optional<std::vector<uint64_t>>
+	storePayload(const std::vector<char>& payload, CompressionLevel level);
+	// Blocks nothing references are still there until the next compaction
+	bool hasBlocks(const std::vector<uint64_t>& hashes);
+	// Blocks shared with other checkpoints count fully
+	uint64_t getStoredSize(const std::vector<uint64_t>& hashes);
+	void retainBlocks(const std::vector<uint64_t>& hashes);
+	void releaseBlocks(const std::vector<uint64_t>& hashes);
+	// The payload is read into the given buffer, reusing its memory
+	bool readPayload(
+		const std::vector<uint64_t>& hashes, uint64_t rawSize,
+		std::vector<char>& payload
+	);
+
+private:
+	std::filesystem::path m_path;
+	std::unordered_map<uint64_t, StoredBlock> m_blocks;
+	uint64_t m_size = 0;
+	uint64_t m_liveSize = 0;
+	// Stores from other versions are left alone
+	bool m_readOnly = false;
+	// Compressed blocks are decoded into it before they're added to a payload
+	std::vector<char> m_blockBuffer;
+
+	void changeReferences(const std::vector<uint64_t>& hashes, int change);
+	void compact();
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+template <typename T>
+void appendValue(std::vector<char>& buffer, const T& value) {
+	const char* bytes = reinterpret_cast<const char*>(&value);
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+// Bounds checked cursor over a byte range, a read that doesn't fit fails and
+// leaves the cursor where it was
+class ByteReader {
+public:
+	ByteReader(const char* data, uint64_t size) : m_data(data), m_size(size) {}
+
+	bool read(char* out, uint64_t size) {
+		if (size > remaining())
+			return false;
+
+		std::memcpy(out, m_data + m_position, size);
+		m_position += size;
+		return true;
+	}
+
+	template <typename T>
+	bool read(T& value) {
+		return read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	// Contiguous arrays are copied in one go
+	template <typename T>
+	bool readArray(std::vector<T>& values, uint64_t count) {
+		if (count > remaining() / sizeof(T))
+			return false;
+
+		values.resize(count);
+		return read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+	}
+
+	bool skip(uint64_t size) {
+		if (size > remaining())
+			return false;
+
+		m_position += size;
+		return true;
+	}
+
+	bool seek(uint64_t position) {
+		if (position > m_size)
+			return false;
+
+		m_position = position;
+		return true;
+	}
+
+	const char* data() const { return m_data; }
+	uint64_t size() const { return m_size; }
+	uint64_t position() const { return m_position; }
+	uint64_t remaining() const { return m_size - m_position; }
+
+private:
+	const char* m_data;
+	uint64_t m_size;
+	uint64_t m_position = 0;
+};
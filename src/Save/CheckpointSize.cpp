@@ -0,0 +1,48 @@
+#include "CheckpointSize.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <numeric>
+
+const char* getCheckpointSectionName(CheckpointSection section) {
+	switch (section) {
+	case CheckpointSection::GameState:
+		return "Game state";
+	case CheckpointSection::Players:
+		return "Players";
+	case CheckpointSection::ObjectStates:
+		return "Object states";
+	case CheckpointSection::EffectManager:
+		return "Effect manager";
+	case CheckpointSection::Gradients:
+		return "Gradients";
+	case CheckpointSection::SequenceTriggers:
+		return "Sequence triggers";
+	case CheckpointSection::Progress:
+		return "Progress";
+	default:
+		return "";
+	}
+}
+
+uint64_t& CheckpointSize::operator[](CheckpointSection section) {
+	return m_sections[(unsigned int)section];
+}
+
+uint64_t CheckpointSize::operator[](CheckpointSection section) const {
+	return m_sections[(unsigned int)section];
+}
+
+uint64_t CheckpointSize::getTotal() const {
+	return std::accumulate(m_sections.begin(), m_sections.end(), (uint64_t)0);
+}
+
+std::string formatByteSize(uint64_t size) {
+	if (size < 1024)
+		return fmt::format("{} B", size);
+	if (size < 1024 * 1024)
+		return fmt::format("{:.1f} KB", size / 1024.);
+	if (size < 1024 * 1024 * 1024)
+		return fmt::format("{:.1f} MB", size / (1024. * 1024.));
+	return fmt::format("{:.2f} GB", size / (1024. * 1024. * 1024.));
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Parts of a checkpoint, in the order they're serialized
+enum class CheckpointSection : unsigned char {
+	// Node, game, shader and audio state
+	GameState,
+	Players,
+	ObjectStates,
+	EffectManager,
+	Gradients,
+	SequenceTriggers,
+	// Position, time, percent and persistent items
+	Progress,
+};
+
+const unsigned int CHECKPOINT_SECTION_COUNT = 7;
+
+const char* getCheckpointSectionName(CheckpointSection section);
+
+// Bytes taken by each section of a checkpoint
+struct CheckpointSize {
+	std::array<uint64_t, CHECKPOINT_SECTION_COUNT> m_sections{};
+
+	uint64_t& operator[](CheckpointSection section);
+	uint64_t operator[](CheckpointSection section) const;
+	uint64_t getTotal() const;
+};
+
+// Like "1.5 MB"
+std::string formatByteSize(uint64_t size);
@@ -0,0 +1,159 @@
+#include "Checksum.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32C_X86
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__)
+#define CRC32C_ARM
+#include <arm_acle.h>
+#if !defined(__ARM_FEATURE_CRC32) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#define CRC32C_TARGET(features) __attribute__((target(features)))
+#else
+#define CRC32C_TARGET(features)
+#endif
+
+// Reflected Castagnoli polynomial
+const uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+// Slicing by 8, table[k][b] is the CRC of byte b followed by k zero bytes
+static constexpr std::array<std::array<uint32_t, 256>, 8> createTables() {
+	std::array<std::array<uint32_t, 256>, 8> tables{};
+
+	for (uint32_t byte = 0; byte < 256; byte++) {
+		uint32_t crc = byte;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+		tables[0][byte] = crc;
+	}
+
+	for (int k = 1; k < 8; k++)
+		for (uint32_t byte = 0; byte < 256; byte++)
+			tables[k][byte] = (tables[k - 1][byte] >> 8) ^
+									tables[0][tables[k - 1][byte] & 0xFF];
+
+	return tables;
+}
+
+static constexpr std::array<std::array<uint32_t, 256>, 8> CRC32C_TABLES =
+	createTables();
+
+static uint32_t crc32cSoftware(
+	uint32_t crc, const unsigned char* input, uint64_t size
+) {
+	while (size >= 8) {
+		uint64_t word;
+		std::memcpy(&word, input, sizeof(word));
+		word ^= crc;
+
+		crc = CRC32C_TABLES[7][word & 0xFF] ^
+				CRC32C_TABLES[6][(word >> 8) & 0xFF] ^
+				CRC32C_TABLES[5][(word >> 16) & 0xFF] ^
+				CRC32C_TABLES[4][(word >> 24) & 0xFF] ^
+				CRC32C_TABLES[3][(word >> 32) & 0xFF] ^
+				CRC32C_TABLES[2][(word >> 40) & 0xFF] ^
+				CRC32C_TABLES[1][(word >> 48) & 0xFF] ^
+				CRC32C_TABLES[0][word >> 56];
+
+		input += 8;
+		size -= 8;
+	}
+
+	while (size > 0) {
+		crc = (crc >> 8) ^ CRC32C_TABLES[0][(crc ^ *input) & 0xFF];
+		input++;
+		size--;
+	}
+
+	return crc;
+}
+
+#if defined(CRC32C_X86)
+CRC32C_TARGET("sse4.2")
+static uint32_t crc32cHardware(
+	uint32_t crc, const unsigned char* input, uint64_t size
+) {
+	uint64_t crc64 = crc;
+	while (size >= 8) {
+		uint64_t word;
+		std::memcpy(&word, input, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+		input += 8;
+		size -= 8;
+	}
+
+	crc = (uint32_t)crc64;
+	while (size > 0) {
+		crc = _mm_crc32_u8(crc, *input);
+		input++;
+		size--;
+	}
+
+	return crc;
+}
+
+static bool hasHardwareSupport() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(CRC32C_ARM)
+CRC32C_TARGET("crc")
+static uint32_t crc32cHardware(
+	uint32_t crc, const unsigned char* input, uint64_t size
+) {
+	while (size >= 8) {
+		uint64_t word;
+		std::memcpy(&word, input, sizeof(word));
+		crc = __crc32cd(crc, word);
+		input += 8;
+		size -= 8;
+	}
+
+	while (size > 0) {
+		crc = __crc32cb(crc, *input);
+		input++;
+		size--;
+	}
+
+	return crc;
+}
+
+static bool hasHardwareSupport() {
+#if defined(__ARM_FEATURE_CRC32)
+	return true;
+#elif defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+	return false;
+#endif
+}
+#endif
+
+uint32_t crc32c(const void* data, uint64_t size, uint32_t previous) {
+	const unsigned char* input = static_cast<const unsigned char*>(data);
+	uint32_t crc = ~previous;
+
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+	static const bool hardwareSupport = hasHardwareSupport();
+	if (hardwareSupport)
+		return ~crc32cHardware(crc, input, size);
+#endif
+
+	return ~crc32cSoftware(crc, input, size);
+}
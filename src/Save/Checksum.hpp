@@ -0,0 +1,6 @@
+#pragma once
+#include <cstdint>
+
+// CRC32C, hardware accelerated where the CPU supports it. Checksums can be
+// chained by passing the checksum of the previous bytes
+uint32_t crc32c(const void* data, uint64_t size, uint32_t previous = 0);
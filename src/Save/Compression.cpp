@@ -0,0 +1,280 @@
+#include "Compression.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+using namespace geode::prelude;
+
+// Sequences are stored like LZ4: a token with the literal and match lengths,
+// the literals and a 16 bit offset back into the already decoded data
+const uint64_t MIN_MATCH = 4;
+const uint64_t MAX_OFFSET = 0xFFFF;
+const unsigned int HASH_BITS = 16;
+const unsigned int SMALL_SEARCH_DEPTH = 64;
+const uint64_t DICTIONARY_SEGMENT_SIZE = 64;
+
+CompressionLevel getCompressionLevel() {
+	std::string level =
+		Mod::get()->getSettingValue<std::string>("save-compression");
+
+	if (level == "Fast")
+		return CompressionLevel::Fast;
+	if (level == "Small")
+		return CompressionLevel::Small;
+	return CompressionLevel::None;
+}
+
+static uint32_t hashSequence(const char* data) {
+	uint32_t sequence;
+	std::memcpy(&sequence, data, sizeof(sequence));
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void appendLength(std::vector<char>& out, uint64_t length) {
+	while (length >= 255) {
+		out.push_back((char)255);
+		length -= 255;
+	}
+	out.push_back((char)length);
+}
+
+static void appendSequence(
+	std::vector<char>& out, const char* literals, uint64_t literalLength,
+	uint64_t offset, uint64_t matchLength
+) {
+	uint64_t matchToken = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+
+	out.push_back(
+		(char)((std::min<uint64_t>(literalLength, 15) << 4) |
+				 std::min<uint64_t>(matchToken, 15))
+	);
+	if (literalLength >= 15)
+		appendLength(out, literalLength - 15);
+
+	out.insert(out.end(), literals, literals + literalLength);
+
+	if (matchLength == 0)
+		return;
+
+	out.push_back((char)(offset & 0xFF));
+	out.push_back((char)(offset >> 8));
+	if (matchToken >= 15)
+		appendLength(out, matchToken - 15);
+}
+
+std::vector<char> compressPayload(
+	const char* data, uint64_t size, const std::vector<char>& dictionary,
+	CompressionLevel level
+) {
+	// Matching is done over the dictionary and the payload as one buffer
+	std::vector<char> window(dictionary);
+	window.insert(window.end(), data, data + size);
+
+	const uint64_t start = dictionary.size();
+	const uint64_t end = window.size();
+
+	std::vector<int64_t> head(1 << HASH_BITS, -1);
+	std::vector<int64_t> chain;
+	if (level == CompressionLevel::Small)
+		chain.resize(end, -1);
+
+	auto insert = [&](uint64_t position) {
+		if (position + MIN_MATCH > end)
+			return;
+
+		uint32_t hash = hashSequence(window.data() + position);
+		if (!chain.empty())
+			chain[position] = head[hash];
+		head[hash] = position;
+	};
+
+	for (uint64_t position = 0; position < start; position++)
+		insert(position);
+
+	std::vector<char> out;
+	out.reserve(size / 2);
+
+	uint64_t anchor = start;
+	uint64_t position = start;
+
+	while (position + MIN_MATCH <= end) {
+		uint64_t bestLength = 0;
+		uint64_t bestOffset = 0;
+
+		int64_t candidate = head[hashSequence(window.data() + position)];
+		unsigned int depth =
+			level == CompressionLevel::Small ? SMALL_SEARCH_DEPTH : 1;
+
+		while (candidate >= 0 && depth > 0 &&
+				 position - candidate <= MAX_OFFSET) {
+			uint64_t length = 0;
+			while (position + length < end &&
+					 window[candidate + length] == window[position + length])
+				length++;
+
+			if (length > bestLength) {
+				bestLength = length;
+				bestOffset = position - candidate;
+			}
+
+			if (chain.empty())
+				break;
+			candidate = chain[candidate];
+			depth--;
+		}
+
+		if (bestLength < MIN_MATCH) {
+			insert(position);
+			position++;
+			continue;
+		}
+
+		appendSequence(
+			out, window.data() + anchor, position - anchor, bestOffset,
+			bestLength
+		);
+
+		for (uint64_t i = 0; i < bestLength; i++)
+			insert(position + i);
+
+		position += bestLength;
+		anchor = position;
+	}
+
+	appendSequence(out, window.data() + anchor, end - anchor, 0, 0);
+
+	return out;
+}
+
+static bool readLength(
+	const unsigned char*& input, const unsigned char* inputEnd, uint64_t& length
+) {
+	while (true) {
+		if (input >= inputEnd)
+			return false;
+
+		unsigned char value = *input++;
+		length += value;
+		if (value != 255)
+			return true;
+	}
+}
+
+bool decompressPayload(
+	const char* data, uint64_t size, const std::vector<char>& dictionary,
+	std::vector<char>& out, uint64_t rawSize
+) {
+	// Decoded next to the dictionary so matches can reach back into it. The
+	// output is used as the window, so a reused output doesn't allocate
+	std::vector<char>& window = out;
+	window.assign(dictionary.begin(), dictionary.end());
+	window.resize(dictionary.size() + rawSize);
+
+	const unsigned char* input = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* inputEnd = input + size;
+	uint64_t position = dictionary.size();
+
+	while (true) {
+		if (input >= inputEnd)
+			return false;
+
+		unsigned char token = *input++;
+
+		uint64_t literalLength = token >> 4;
+		if (literalLength == 15 && !readLength(input, inputEnd, literalLength))
+			return false;
+
+		if (literalLength > (uint64_t)(inputEnd - input) ||
+			 literalLength > window.size() - position)
+			return false;
+
+		std::memcpy(window.data() + position, input, literalLength);
+		input += literalLength;
+		position += literalLength;
+
+		if (position == window.size())
+			break;
+
+		if (inputEnd - input < 2)
+			return false;
+
+		uint64_t offset = input[0] | (input[1] << 8);
+		input += 2;
+
+		uint64_t matchLength = token & 15;
+		if (matchLength == 15 && !readLength(input, inputEnd, matchLength))
+			return false;
+		matchLength += MIN_MATCH;
+
+		if (offset == 0 || offset > position ||
+			 matchLength > window.size() - position)
+			return false;
+
+		// Matches can overlap the bytes they produce, so they're copied one
+		// byte at a time
+		for (uint64_t i = 0; i < matchLength; i++)
+			window[position + i] = window[position - offset + i];
+		position += matchLength;
+	}
+
+	if (input != inputEnd)
+		return false;
+
+	window.erase(window.begin(), window.begin() + dictionary.size());
+	return true;
+}
+
+std::vector<char> trainDictionary(const std::vector<std::vector<char>>& samples
+) {
+	struct Segment {
+		const char* m_data;
+		unsigned int m_count;
+	};
+
+	std::unordered_map<std::string_view, Segment> segments;
+
+	for (const std::vector<char>& sample : samples)
+		for (uint64_t offset = 0;
+			  offset + DICTIONARY_SEGMENT_SIZE <= sample.size();
+			  offset += DICTIONARY_SEGMENT_SIZE) {
+			std::string_view key(
+				sample.data() + offset, DICTIONARY_SEGMENT_SIZE
+			);
+
+			auto [segment, inserted] =
+				segments.try_emplace(key, Segment{key.data(), 0});
+			segment->second.m_count++;
+		}
+
+	std::vector<Segment> rankedSegments;
+	for (auto& [key, segment] : segments)
+		if (segment.m_count > 1)
+			rankedSegments.push_back(segment);
+
+	std::sort(
+		rankedSegments.begin(), rankedSegments.end(),
+		[](const Segment& left, const Segment& right) {
+			return left.m_count > right.m_count;
+		}
+	);
+
+	uint64_t segmentCount = std::min<uint64_t>(
+		rankedSegments.size(), MAX_DICTIONARY_SIZE / DICTIONARY_SEGMENT_SIZE
+	);
+
+	// The most common segments go last so they end up closest to the payload
+	std::vector<char> dictionary;
+	dictionary.reserve(segmentCount * DICTIONARY_SEGMENT_SIZE);
+	for (uint64_t i = segmentCount; i > 0; i--) {
+		const char* segment = rankedSegments[i - 1].m_data;
+		dictionary.insert(
+			dictionary.end(), segment, segment + DICTIONARY_SEGMENT_SIZE
+		);
+	}
+
+	return dictionary;
+}
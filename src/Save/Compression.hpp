@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// How a checkpoint payload is stored in the save
+enum class PayloadEncoding : char {
+	Raw = 0,
+	LZ = 1,
+	LZDictionary = 2,
+	// The record only lists the hashes of blocks in the level's block store
+	Blocks = 3,
+	// Difference from the baseline of the layer
+	Delta = 4,
+	// Compressed difference, after its decompressed size
+	DeltaLZ = 5,
+};
+
+enum class CompressionLevel {
+	None,
+	Fast,
+	Small,
+};
+
+const uint64_t MAX_DICTIONARY_SIZE = 32 * 1024;
+// A layer needs this many checkpoints before a dictionary is trained for it
+const unsigned int MIN_DICTIONARY_SAMPLES = 4;
+
+CompressionLevel getCompressionLevel();
+
+// The dictionary is used as data that comes right before the payload, so
+// matches can point into it
+std::vector<char> compressPayload(
+	const char* data, uint64_t size, const std::vector<char>& dictionary,
+	CompressionLevel level
+);
+// Returns false if the payload is corrupted, the output is left with
+// undefined contents then
+bool decompressPayload(
+	const char* data, uint64_t size, const std::vector<char>& dictionary,
+	std::vector<char>& out, uint64_t rawSize
+);
+
+// Picks the segments that repeat the most across the samples
+std::vector<char> trainDictionary(const std::vector<std::vector<char>>& samples
+);
@@ -0,0 +1,125 @@
+#include "Delta.hpp"
+#include "ByteBuffer.hpp"
+
+#include <algorithm>
+
+// Shorter runs of equal bytes cost more as their own pair than inside the
+// XORed run
+const uint64_t MIN_EQUAL_RUN = 3;
+
+static void appendVarint(std::vector<char>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+static bool readVarint(ByteReader& reader, uint64_t& value) {
+	value = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		unsigned char byte;
+		if (!reader.read(byte))
+			return false;
+
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+std::vector<char> encodeDelta(
+	const std::vector<char>& baseline, const char* data, uint64_t size
+) {
+	uint64_t baselineSize = baseline.size();
+	auto differenceAt = [&](uint64_t position) -> char {
+		if (position < baselineSize)
+			return data[position] ^ baseline[position];
+		return data[position];
+	};
+
+	std::vector<char> delta;
+	uint64_t position = 0;
+
+	while (position < size) {
+		uint64_t equalEnd = position;
+		while (equalEnd < size && differenceAt(equalEnd) == 0)
+			equalEnd++;
+
+		uint64_t differentEnd = equalEnd;
+		while (differentEnd < size) {
+			if (differenceAt(differentEnd) != 0) {
+				differentEnd++;
+				continue;
+			}
+
+			uint64_t equalRun = 0;
+			while (differentEnd + equalRun < size && equalRun < MIN_EQUAL_RUN &&
+					 differenceAt(differentEnd + equalRun) == 0)
+				equalRun++;
+
+			if (equalRun >= MIN_EQUAL_RUN || differentEnd + equalRun == size)
+				break;
+			differentEnd += equalRun;
+		}
+
+		appendVarint(delta, equalEnd - position);
+		appendVarint(delta, differentEnd - equalEnd);
+		for (uint64_t i = equalEnd; i < differentEnd; i++)
+			delta.push_back(differenceAt(i));
+
+		position = differentEnd;
+	}
+
+	return delta;
+}
+
+bool decodeDelta(
+	const char* delta, uint64_t size, const std::vector<char>& baseline,
+	std::vector<char>& out, uint64_t rawSize
+) {
+	out.clear();
+	out.reserve(rawSize);
+
+	// Copies the baseline into the output, with zeros past its end
+	auto appendBaseline = [&](uint64_t length) {
+		uint64_t start = out.size();
+		uint64_t copied =
+			start < baseline.size()
+				? std::min<uint64_t>(length, baseline.size() - start)
+				: 0;
+
+		out.insert(
+			out.end(), baseline.begin() + start,
+			baseline.begin() + start + copied
+		);
+		out.resize(start + length, 0);
+	};
+
+	ByteReader reader(delta, size);
+	while (reader.remaining() > 0) {
+		uint64_t equalLength;
+		uint64_t differentLength;
+		if (!readVarint(reader, equalLength) ||
+			 !readVarint(reader, differentLength))
+			return false;
+
+		if (equalLength > rawSize - out.size() ||
+			 differentLength > rawSize - out.size() - equalLength ||
+			 differentLength > reader.remaining())
+			return false;
+
+		appendBaseline(equalLength);
+
+		uint64_t start = out.size();
+		appendBaseline(differentLength);
+		const char* different = reader.data() + reader.position();
+		for (uint64_t i = 0; i < differentLength; i++)
+			out[start + i] ^= different[i];
+		reader.skip(differentLength);
+	}
+
+	return out.size() == rawSize;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Payloads XORed with a layer baseline are mostly zeros. They're stored as
+// pairs of varint lengths: a run of bytes equal to the baseline, then a run
+// of XORed bytes. Bytes past the end of the baseline are XORed with 0
+std::vector<char> encodeDelta(
+	const std::vector<char>& baseline, const char* data, uint64_t size
+);
+// Returns false if the delta is corrupted
+bool decodeDelta(
+	const char* delta, uint64_t size, const std::vector<char>& baseline,
+	std::vector<char>& out, uint64_t rawSize
+);
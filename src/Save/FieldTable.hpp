@@ -0,0 +1,99 @@
+#pragma once
+#include <sabe.persistenceapi/include/util/Stream.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Class and type of a field from its member pointer
+template <auto Member>
+struct FieldTraits;
+
+template <typename Class, typename Type, Type Class::* Member>
+struct FieldTraits<Member> {
+	using ClassType = Class;
+	using ValueType = Type;
+};
+
+// Trivially copyable fields that are streamed one after another are packed
+// into a single write. The stream writes these types as their raw bytes, so
+// the output is the same as streaming them one by one
+template <auto First, auto... Rest>
+struct FieldRun {
+	using Class = typename FieldTraits<First>::ClassType;
+
+	static_assert(
+		(std::is_trivially_copyable_v<typename FieldTraits<First>::ValueType> &&
+		 ... &&
+		 std::is_trivially_copyable_v<typename FieldTraits<Rest>::ValueType>)
+	);
+
+	static constexpr size_t SIZE =
+		(sizeof(typename FieldTraits<First>::ValueType) + ... +
+		 sizeof(typename FieldTraits<Rest>::ValueType));
+
+	static void save(persistenceAPI::Stream& out, Class& object) {
+		char buffer[SIZE];
+		size_t offset = 0;
+		pack(buffer, offset, object.*First);
+		(pack(buffer, offset, object.*Rest), ...);
+
+		out.write(buffer, SIZE);
+	}
+
+	static void load(persistenceAPI::Stream& in, Class& object) {
+		char buffer[SIZE];
+		in.read(buffer, SIZE);
+
+		size_t offset = 0;
+		unpack(buffer, offset, object.*First);
+		(unpack(buffer, offset, object.*Rest), ...);
+	}
+
+private:
+	template <typename T>
+	static void pack(char* buffer, size_t& offset, const T& value) {
+		std::memcpy(buffer + offset, &value, sizeof(T));
+		offset += sizeof(T);
+	}
+
+	template <typename T>
+	static void unpack(const char* buffer, size_t& offset, T& value) {
+		std::memcpy(&value, buffer + offset, sizeof(T));
+		offset += sizeof(T);
+	}
+};
+
+// Fields that go through their own stream operators (containers and types
+// the stream has a special case for)
+template <auto First, auto... Rest>
+struct StreamedFields {
+	using Class = typename FieldTraits<First>::ClassType;
+
+	static void save(persistenceAPI::Stream& out, Class& object) {
+		out << object.*First;
+		((out << object.*Rest), ...);
+	}
+
+	static void load(persistenceAPI::Stream& in, Class& object) {
+		in >> object.*First;
+		((in >> object.*Rest), ...);
+	}
+};
+
+// Ordered list of field groups, the encoder and the decoder are both
+// generated from it so they can't drift apart. It can't size a payload,
+// streamed fields are written in the persistence API's format and their size
+// is only known by encoding them
+template <typename... Groups>
+struct FieldTable {
+	template <typename Class>
+	static void save(persistenceAPI::Stream& out, Class& object) {
+		(Groups::save(out, object), ...);
+	}
+
+	template <typename Class>
+	static void load(persistenceAPI::Stream& in, Class& object) {
+		(Groups::load(in, object), ...);
+	}
+};
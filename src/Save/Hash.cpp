@@ -0,0 +1,91 @@
+#include "Hash.hpp"
+
+#include <cstring>
+
+const uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+const uint64_t PRIME_4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t PRIME_5 = 0x27D4EB2F165667C5ull;
+
+static uint64_t rotateLeft(uint64_t value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const unsigned char* data) {
+	uint64_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint32_t read32(const unsigned char* data) {
+	uint32_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint64_t round(uint64_t accumulator, uint64_t input) {
+	accumulator += input * PRIME_2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * PRIME_1;
+}
+
+static uint64_t mergeRound(uint64_t accumulator, uint64_t value) {
+	accumulator ^= round(0, value);
+	return accumulator * PRIME_1 + PRIME_4;
+}
+
+uint64_t hashBytes(const void* data, uint64_t size, uint64_t seed) {
+	const unsigned char* input = static_cast<const unsigned char*>(data);
+	const unsigned char* end = input + size;
+	uint64_t hash;
+
+	if (size >= 32) {
+		uint64_t accumulators[4] = {
+			seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1
+		};
+
+		const unsigned char* limit = end - 32;
+		do {
+			for (uint64_t& accumulator : accumulators) {
+				accumulator = round(accumulator, read64(input));
+				input += 8;
+			}
+		} while (input <= limit);
+
+		hash = rotateLeft(accumulators[0], 1) + rotateLeft(accumulators[1], 7) +
+				 rotateLeft(accumulators[2], 12) + rotateLeft(accumulators[3], 18);
+		for (uint64_t accumulator : accumulators)
+			hash = mergeRound(hash, accumulator);
+	} else {
+		hash = seed + PRIME_5;
+	}
+
+	hash += size;
+
+	while (input + 8 <= end) {
+		hash ^= round(0, read64(input));
+		hash = rotateLeft(hash, 27) * PRIME_1 + PRIME_4;
+		input += 8;
+	}
+
+	if (input + 4 <= end) {
+		hash ^= read32(input) * PRIME_1;
+		hash = rotateLeft(hash, 23) * PRIME_2 + PRIME_3;
+		input += 4;
+	}
+
+	while (input < end) {
+		hash ^= *input * PRIME_5;
+		hash = rotateLeft(hash, 11) * PRIME_1;
+		input++;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME_2;
+	hash ^= hash >> 29;
+	hash *= PRIME_3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include <cstdint>
+
+// XXH64
+uint64_t hashBytes(const void* data, uint64_t size, uint64_t seed = 0);
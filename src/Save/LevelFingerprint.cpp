@@ -0,0 +1,37 @@
+#include "LevelFingerprint.hpp"
+#include "Hash.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <unordered_map>
+
+using namespace geode::prelude;
+
+static std::unordered_map<std::string, uint64_t> s_fingerprintCache;
+
+uint64_t getLevelFingerprint(GJGameLevel* level, LevelHash hash) {
+	const gd::string& levelString = level->m_levelString;
+
+	std::string key = fmt::format(
+		"{}\n{}\n{}\n{}", (int)hash, std::string(level->m_levelName),
+		level->m_levelRev, levelString.size()
+	);
+
+	auto cached = s_fingerprintCache.find(key);
+	if (cached != s_fingerprintCache.end())
+		return cached->second;
+
+	uint64_t fingerprint;
+	switch (hash) {
+	case LevelHash::Std:
+		fingerprint = std::hash<std::string>()(levelString);
+		break;
+	case LevelHash::XXH64:
+	default:
+		fingerprint = hashBytes(levelString.data(), levelString.size());
+		break;
+	}
+
+	s_fingerprintCache.emplace(std::move(key), fingerprint);
+	return fingerprint;
+}
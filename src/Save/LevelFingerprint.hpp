@@ -0,0 +1,18 @@
+#pragma once
+#include <Geode/binding/GJGameLevel.hpp>
+
+#include <cstdint>
+
+// Hash used for the level string of editor levels, saved in the header so it
+// can change without invalidating older saves
+enum class LevelHash : char {
+	// std::hash, used by saves before version 8
+	Std = 0,
+	XXH64 = 1,
+};
+
+const LevelHash CURRENT_LEVEL_HASH = LevelHash::XXH64;
+
+// Fingerprints are cached for the whole session by level name, revision and
+// level string length, so replaying a level doesn't hash it again
+uint64_t getLevelFingerprint(GJGameLevel* level, LevelHash hash);
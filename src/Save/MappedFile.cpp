@@ -0,0 +1,102 @@
+#include "MappedFile.hpp"
+
+#include <Geode/Geode.hpp>
+
+#ifdef GEODE_IS_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+// The file and mapping handles are closed right away, the view keeps the
+// mapping alive until it's unmapped
+bool MappedFile::open(const std::filesystem::path& path, uint64_t maxSize) {
+	close();
+
+#ifdef GEODE_IS_WINDOWS
+	HANDLE file = CreateFileW(
+		path.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+	);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	m_size = (std::min)((uint64_t)fileSize.QuadPart, maxSize);
+	if (m_size == 0) {
+		CloseHandle(file);
+		m_open = true;
+		return true;
+	}
+
+	HANDLE mapping =
+		CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (mapping == nullptr)
+		return false;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, m_size);
+	CloseHandle(mapping);
+	if (view == nullptr)
+		return false;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0) {
+		::close(file);
+		return false;
+	}
+
+	m_size = std::min((uint64_t)fileStat.st_size, maxSize);
+	if (m_size == 0) {
+		::close(file);
+		m_open = true;
+		return true;
+	}
+
+	void* view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED)
+		return false;
+#endif
+
+	m_data = static_cast<const char*>(view);
+	m_open = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (m_data != nullptr) {
+#ifdef GEODE_IS_WINDOWS
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+bool MappedFile::isOpen() const { return m_open; }
+
+const char* MappedFile::data() const { return m_data; }
+
+uint64_t MappedFile::size() const { return m_size; }
+
+ByteReader MappedFile::reader() const { return ByteReader(m_data, m_size); }
@@ -0,0 +1,29 @@
+#pragma once
+#include "ByteBuffer.hpp"
+
+#include <cstdint>
+#include <filesystem>
+
+// Read only memory mapping of a save file. The file can't be written while
+// it's mapped on Windows, so mappings must be closed before queueing writes
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	// Maps at most maxSize bytes from the start of the file
+	bool open(const std::filesystem::path& path, uint64_t maxSize = UINT64_MAX);
+	void close();
+
+	bool isOpen() const;
+	const char* data() const;
+	uint64_t size() const;
+	ByteReader reader() const;
+
+private:
+	const char* m_data = nullptr;
+	uint64_t m_size = 0;
+	bool m_open = false;
+};
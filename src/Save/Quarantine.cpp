@@ -0,0 +1,22 @@
+#include "Quarantine.hpp"
+#include "ByteBuffer.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+using namespace geode::prelude;
+
+void quarantineData(
+	const std::filesystem::path& path, const char* data, uint64_t size
+) {
+	log::warn(
+		"Moving {} damaged bytes to {}", size, string::pathToString(path)
+	);
+
+	std::vector<char> quarantine;
+	quarantine.reserve(sizeof(size) + size);
+	appendValue(quarantine, size);
+	quarantine.insert(quarantine.end(), data, data + size);
+
+	SaveWriter::get()->append(path, std::move(quarantine));
+}
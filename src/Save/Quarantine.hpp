@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+
+// Damaged parts of saves are moved to a side file instead of being thrown
+// away, each one as its size followed by the bytes
+void quarantineData(
+	const std::filesystem::path& path, const char* data, uint64_t size
+);
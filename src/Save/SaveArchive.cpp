@@ -0,0 +1,134 @@
+#include "SaveArchive.hpp"
+#include "ByteBuffer.hpp"
+#include "Compression.hpp"
+#include "MappedFile.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <cstring>
+
+using namespace geode::prelude;
+
+const char ARCHIVE_HEADER[] = "PCP ARCHIVE";
+const unsigned int ARCHIVE_VERSION = 1;
+
+// Files of a level that get archived, quarantined data is left out
+const char* const ARCHIVED_EXTENSIONS[] = {".pcpc", ".pcpb", ".pcpt"};
+
+// Each file is stored as its extension, its size, how it's encoded and the
+// encoded data
+bool archiveLevelSaves(
+	const std::filesystem::path& basePath,
+	const std::filesystem::path& archivePath
+) {
+	SaveWriter::get()->flush();
+
+	std::vector<char> archive(
+		ARCHIVE_HEADER, ARCHIVE_HEADER + sizeof(ARCHIVE_HEADER)
+	);
+	appendValue(archive, ARCHIVE_VERSION);
+
+	for (const char* extension : ARCHIVED_EXTENSIONS) {
+		std::filesystem::path path = basePath;
+		path.concat(extension);
+
+		MappedFile file;
+		if (!file.open(path))
+			continue;
+
+		std::vector<char> data = compressPayload(
+			file.data(), file.size(), {}, CompressionLevel::Small
+		);
+		PayloadEncoding encoding = PayloadEncoding::LZ;
+		if (data.empty() || data.size() >= file.size()) {
+			data.assign(file.data(), file.data() + file.size());
+			encoding = PayloadEncoding::Raw;
+		}
+
+		appendValue(archive, (char)std::strlen(extension));
+		archive.insert(archive.end(), extension, extension + strlen(extension));
+		appendValue(archive, file.size());
+		appendValue(archive, encoding);
+		appendValue(archive, (uint64_t)data.size());
+		archive.insert(archive.end(), data.begin(), data.end());
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(archivePath.parent_path(), error);
+
+	SaveWriter::get()->write(archivePath, std::move(archive));
+	SaveWriter::get()->flush();
+
+	return std::filesystem::exists(archivePath);
+}
+
+bool restoreLevelSaves(
+	const std::filesystem::path& archivePath,
+	const std::filesystem::path& basePath
+) {
+	SaveWriter::get()->flush();
+
+	MappedFile archive;
+	if (!archive.open(archivePath))
+		return false;
+
+	ByteReader reader = archive.reader();
+
+	char header[sizeof(ARCHIVE_HEADER)];
+	unsigned int version;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version) ||
+		 std::memcmp(header, ARCHIVE_HEADER, sizeof(header)) != 0 ||
+		 version != ARCHIVE_VERSION) {
+		log::error(
+			"Invalid save archive {}", string::pathToString(archivePath)
+		);
+		return false;
+	}
+
+	// Every file is unpacked before anything is written, so a damaged archive
+	// doesn't restore only some of them
+	std::vector<std::pair<std::filesystem::path, std::vector<char>>> files;
+	while (reader.remaining() > 0) {
+		char extensionSize;
+		std::string extension;
+		uint64_t rawSize;
+		PayloadEncoding encoding;
+		uint64_t storedSize;
+
+		if (!reader.read(extensionSize) ||
+			 (uint64_t)extensionSize > reader.remaining())
+			return false;
+
+		extension.assign(reader.data() + reader.position(), extensionSize);
+		reader.skip(extensionSize);
+
+		if (!reader.read(rawSize) || !reader.read(encoding) ||
+			 !reader.read(storedSize) || storedSize > reader.remaining())
+			return false;
+
+		const char* data = reader.data() + reader.position();
+		reader.skip(storedSize);
+
+		std::vector<char> file;
+		if (encoding == PayloadEncoding::Raw && storedSize == rawSize)
+			file.assign(data, data + storedSize);
+		else if (encoding != PayloadEncoding::LZ ||
+					!decompressPayload(data, storedSize, {}, file, rawSize))
+			return false;
+
+		std::filesystem::path path = basePath;
+		path.concat(extension);
+		files.emplace_back(path, std::move(file));
+	}
+
+	archive.close();
+
+	for (auto& [path, file] : files)
+		SaveWriter::get()->write(path, std::move(file));
+	SaveWriter::get()->flush();
+
+	std::error_code error;
+	std::filesystem::remove(archivePath, error);
+	return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <filesystem>
+
+// Levels evicted by the storage limit can have their save files compressed
+// into a single archive, which is unpacked the next time the level is played
+bool archiveLevelSaves(
+	const std::filesystem::path& basePath,
+	const std::filesystem::path& archivePath
+);
+bool restoreLevelSaves(
+	const std::filesystem::path& archivePath,
+	const std::filesystem::path& basePath
+);
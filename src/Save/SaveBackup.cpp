@@ -0,0 +1,515 @@
+#include "SaveBackup.hpp"
+#include "ByteBuffer.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "SavePath.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <unordered_set>
+
+using namespace geode::prelude;
+
+const char SNAPSHOT_HEADER[] = "PCP SNAPSHOT";
+const unsigned int SNAPSHOT_VERSION = 1;
+
+// Files of a level that are restored with it, quarantined data is left out
+const char* const RESTORED_EXTENSIONS[] = {".pcpc", ".pcpb", ".pcpt"};
+
+static int64_t getCurrentTime() { return std::time(nullptr); }
+
+static std::filesystem::path getBackupDirectory() {
+	return Mod::get()->getSaveDir() / "backups";
+}
+
+static std::filesystem::path getObjectPath(
+	const std::filesystem::path& backupDirectory, uint64_t hash
+) {
+	std::string name = fmt::format("{:016x}", hash);
+	return backupDirectory / "objects" / name.substr(0, 2) / name;
+}
+
+static std::string getRelativePath(const std::filesystem::path& path) {
+	return string::pathToString(path.lexically_relative(getSavesDirectory()));
+}
+
+const BackupFile*
+BackupSnapshot::getFile(const std::filesystem::path& path) const {
+	std::string relativePath = getRelativePath(path);
+
+	for (const BackupFile& file : m_files)
+		if (file.m_path == relativePath)
+			return &file;
+
+	return nullptr;
+}
+
+// Each file is stored as its path, size, write time and hash
+static std::vector<char> createManifest(const BackupSnapshot& snapshot) {
+	std::vector<char> manifest(
+		SNAPSHOT_HEADER, SNAPSHOT_HEADER + sizeof(SNAPSHOT_HEADER)
+	);
+	appendValue(manifest, SNAPSHOT_VERSION);
+	appendValue(manifest, snapshot.m_time);
+	appendValue(manifest, (unsigned int)snapshot.m_files.size());
+
+	for (const BackupFile& file : snapshot.m_files) {
+		appendValue(manifest, (unsigned short)file.m_path.size());
+		manifest.insert(manifest.end(), file.m_path.begin(), file.m_path.end());
+		appendValue(manifest, file.m_size);
+		appendValue(manifest, file.m_modified);
+		appendValue(manifest, file.m_hash);
+	}
+
+	return manifest;
+}
+
+static std::optional<BackupSnapshot>
+readManifest(const std::filesystem::path& path) {
+	MappedFile manifest;
+	if (!manifest.open(path))
+		return std::nullopt;
+
+	ByteReader reader = manifest.reader();
+
+	char header[sizeof(SNAPSHOT_HEADER)];
+	unsigned int version;
+	BackupSnapshot snapshot;
+	unsigned int fileCount;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version) ||
+		 std::memcmp(header, SNAPSHOT_HEADER, sizeof(header)) != 0 ||
+		 version != SNAPSHOT_VERSION || !reader.read(snapshot.m_time) ||
+		 !reader.read(fileCount)) {
+		log::error("Invalid backup snapshot {}", string::pathToString(path));
+		return std::nullopt;
+	}
+
+	for (unsigned int i = 0; i < fileCount; i++) {
+		BackupFile file;
+		unsigned short pathSize;
+		if (!reader.read(pathSize) || pathSize > reader.remaining())
+			return std::nullopt;
+
+		file.m_path.assign(reader.data() + reader.position(), pathSize);
+		reader.skip(pathSize);
+
+		if (!reader.read(file.m_size) || !reader.read(file.m_modified) ||
+			 !reader.read(file.m_hash))
+			return std::nullopt;
+
+		snapshot.m_files.push_back(std::move(file));
+	}
+
+	return snapshot;
+}
+
+// Newest first, the file names are the snapshot times. Files with other
+// names are left out
+static std::vector<std::filesystem::path>
+getManifestPaths(const std::filesystem::path& backupDirectory) {
+	std::vector<std::pair<int64_t, std::filesystem::path>> manifests;
+
+	std::error_code error;
+	for (const std::filesystem::directory_entry& file :
+		  std::filesystem::directory_iterator(
+			  backupDirectory / "snapshots", error
+		  )) {
+		if (file.path().extension() != ".pcps")
+			continue;
+
+		std::string stem = string::pathToString(file.path().stem());
+		int64_t time;
+		auto [end, parseError] =
+			std::from_chars(stem.data(), stem.data() + stem.size(), time);
+		if (parseError == std::errc() && end == stem.data() + stem.size())
+			manifests.emplace_back(time, file.path());
+	}
+
+	std::sort(
+		manifests.begin(), manifests.end(),
+		[](const auto& left, const auto& right) {
+			return left.first > right.first;
+		}
+	);
+
+	std::vector<std::filesystem::path> paths;
+	for (auto& [time, path] : manifests)
+		paths.push_back(std::move(path));
+
+	return paths;
+}
+
+// Files are written next to where they go and renamed, so an interrupted
+// backup never leaves a partial file behind
+static bool writeBackupFile(
+	const std::filesystem::path& path, const char* data, uint64_t size
+) {
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::filesystem::path temporaryPath = path;
+	temporaryPath.concat(".tmp");
+
+	std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+	file.write(data, size);
+	file.close();
+	if (!file) {
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	std::filesystem::rename(temporaryPath, path, error);
+	return !error;
+}
+
+// Save files are read in one go instead of being mapped, so the file is only
+// open for the read and a save writer replacing it on Windows doesn't fail
+static std::optional<std::vector<char>>
+readSaveFile(const std::filesystem::path& path) {
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+		return std::nullopt;
+
+	std::vector<char> data(file.tellg());
+	file.seekg(0);
+	if (!file.read(data.data(), data.size()))
+		return std::nullopt;
+
+	return data;
+}
+
+SaveBackup* SaveBackup::get() {
+	static SaveBackup instance;
+	return &instance;
+}
+
+void SaveBackup::snapshotIfDue() {
+	if (Mod::get()->getSettingValue<int64_t>("backup-count") == 0)
+		return;
+
+	int64_t interval =
+		Mod::get()->getSettingValue<int64_t>("backup-interval") * 60;
+	int64_t lastBackup = Mod::get()->getSavedValue<int64_t>("last-backup");
+	if (getCurrentTime() - lastBackup < interval)
+		return;
+
+	snapshot();
+}
+
+void SaveBackup::snapshot() {
+	int64_t time = getCurrentTime();
+	unsigned int keepCount = std::max<int64_t>(
+		Mod::get()->getSettingValue<int64_t>("backup-count"), 1
+	);
+	Mod::get()->setSavedValue("last-backup", time);
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_request = SnapshotRequest{
+			getSavesDirectory(), getBackupDirectory(), time, keepCount
+		};
+
+		if (!m_thread.joinable())
+			m_thread = std::thread(&SaveBackup::run, this);
+	}
+	m_requestCondition.notify_one();
+}
+
+void SaveBackup::wait() {
+	std::unique_lock lock(m_mutex);
+	m_idleCondition.wait(lock, [this] {
+		return !m_request.has_value() && !m_busy;
+	});
+}
+
+SaveBackup::~SaveBackup() {
+	wait();
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopping = true;
+	}
+	m_requestCondition.notify_one();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+// Files written while a snapshot is taken can be backed up part way through
+// an append, journals read them like a save cut short by a crash
+void SaveBackup::run() {
+	std::unique_lock lock(m_mutex);
+
+	while (true) {
+		m_requestCondition.wait(lock, [this] {
+			return m_request.has_value() || m_stopping;
+		});
+
+		if (!m_request.has_value())
+			return;
+
+		SnapshotRequest request = std::move(m_request.value());
+		m_request.reset();
+		m_busy = true;
+
+		lock.unlock();
+		SaveWriter::get()->flush();
+		takeSnapshot(
+			request.m_savesDirectory, request.m_backupDirectory, request.m_time,
+			request.m_keepCount
+		);
+		lock.lock();
+
+		m_busy = false;
+		if (!m_request.has_value())
+			m_idleCondition.notify_all();
+	}
+}
+
+std::vector<BackupSnapshot> SaveBackup::getSnapshots() {
+	wait();
+
+	std::vector<BackupSnapshot> snapshots;
+	for (const std::filesystem::path& path :
+		  getManifestPaths(getBackupDirectory())) {
+		std::optional<BackupSnapshot> snapshot = readManifest(path);
+		if (snapshot.has_value())
+			snapshots.push_back(std::move(snapshot.value()));
+	}
+
+	return snapshots;
+}
+
+std::vector<BackupSnapshot>
+SaveBackup::getLevelSnapshots(const std::filesystem::path& basePath) {
+	std::filesystem::path containerPath = basePath;
+	containerPath.concat(".pcpc");
+
+	std::vector<BackupSnapshot> snapshots = getSnapshots();
+	std::erase_if(snapshots, [&containerPath](const BackupSnapshot& snapshot) {
+		return snapshot.getFile(containerPath) == nullptr;
+	});
+
+	return snapshots;
+}
+
+// Every file is read before anything is written, so a damaged backup doesn't
+// restore only some of them. Files the level didn't have back then are
+// removed
+bool SaveBackup::restoreLevel(
+	const BackupSnapshot& snapshot, const std::filesystem::path& basePath
+) {
+	std::filesystem::path containerPath = basePath;
+	containerPath.concat(".pcpc");
+	if (snapshot.getFile(containerPath) == nullptr)
+		return false;
+
+	wait();
+	SaveWriter::get()->flush();
+
+	using RestoredFile =
+		std::pair<std::filesystem::path, std::optional<std::vector<char>>>;
+	std::vector<RestoredFile> files;
+	for (const char* extension : RESTORED_EXTENSIONS) {
+		std::filesystem::path path = basePath;
+		path.concat(extension);
+
+		const BackupFile* file = snapshot.getFile(path);
+		if (file == nullptr) {
+			files.emplace_back(path, std::nullopt);
+			continue;
+		}
+
+		std::optional<std::vector<char>> data = readFile(*file);
+		if (!data.has_value())
+			return false;
+
+		files.emplace_back(path, std::move(data));
+	}
+
+	for (auto& [path, data] : files)
+		if (data.has_value())
+			SaveWriter::get()->write(path, std::move(data.value()));
+	SaveWriter::get()->flush();
+
+	std::error_code error;
+	for (const auto& [path, data] : files)
+		if (!data.has_value())
+			std::filesystem::remove(path, error);
+
+	return true;
+}
+
+bool SaveBackup::extractFile(
+	const BackupFile& file, const std::filesystem::path& path
+) {
+	std::optional<std::vector<char>> data = readFile(file);
+	if (!data.has_value())
+		return false;
+
+	SaveWriter::get()->write(path, std::move(data.value()));
+	SaveWriter::get()->flush();
+	return true;
+}
+
+// Stored files are checked against their hash, a damaged backup is never
+// restored
+std::optional<std::vector<char>> SaveBackup::readFile(const BackupFile& file) {
+	wait();
+
+	std::filesystem::path objectPath =
+		getObjectPath(getBackupDirectory(), file.m_hash);
+
+	MappedFile object;
+	if (!object.open(objectPath) || object.size() != file.m_size ||
+		 hashBytes(object.data(), object.size()) != file.m_hash) {
+		log::error("Damaged backup of {}", file.m_path);
+		return std::nullopt;
+	}
+
+	return std::vector<char>(object.data(), object.data() + object.size());
+}
+
+// Files that didn't change since the last snapshot keep their hash, the rest
+// are hashed and stored if no snapshot has them yet
+void SaveBackup::takeSnapshot(
+	const std::filesystem::path& savesDirectory,
+	const std::filesystem::path& backupDirectory, int64_t time,
+	unsigned int keepCount
+) {
+	if (!m_loadedLastFiles) {
+		m_loadedLastFiles = true;
+
+		std::vector<std::filesystem::path> manifestPaths =
+			getManifestPaths(backupDirectory);
+		if (!manifestPaths.empty())
+			if (std::optional<BackupSnapshot> lastSnapshot =
+					 readManifest(manifestPaths.front()))
+				for (BackupFile& file : lastSnapshot->m_files)
+					m_lastFiles.emplace(file.m_path, std::move(file));
+	}
+
+	BackupSnapshot snapshot;
+	snapshot.m_time = time;
+	uint64_t storedFiles = 0;
+
+	std::error_code error;
+	std::filesystem::recursive_directory_iterator iterator(
+		savesDirectory, error
+	);
+	for (; !error && iterator != std::filesystem::recursive_directory_iterator();
+		  iterator.increment(error)) {
+		const std::filesystem::directory_entry& entry = *iterator;
+		if (!entry.is_regular_file(error) || entry.path().extension() == ".tmp")
+			continue;
+
+		BackupFile file;
+		file.m_path =
+			string::pathToString(entry.path().lexically_relative(savesDirectory));
+		file.m_size = entry.file_size(error);
+		std::filesystem::file_time_type writeTime = entry.last_write_time(error);
+		if (error) {
+			error.clear();
+			continue;
+		}
+		file.m_modified = writeTime.time_since_epoch().count();
+
+		auto lastFile = m_lastFiles.find(file.m_path);
+		if (lastFile != m_lastFiles.end() &&
+			 lastFile->second.m_size == file.m_size &&
+			 lastFile->second.m_modified == file.m_modified) {
+			file.m_hash = lastFile->second.m_hash;
+			snapshot.m_files.push_back(std::move(file));
+			continue;
+		}
+
+		std::optional<std::vector<char>> source = readSaveFile(entry.path());
+		if (!source.has_value())
+			continue;
+
+		file.m_size = source->size();
+		file.m_hash = hashBytes(source->data(), source->size());
+
+		std::filesystem::path objectPath =
+			getObjectPath(backupDirectory, file.m_hash);
+		if (!std::filesystem::exists(objectPath)) {
+			if (!writeBackupFile(objectPath, source->data(), source->size())) {
+				log::error("Failed to back up {}", file.m_path);
+				continue;
+			}
+			storedFiles++;
+		}
+
+		snapshot.m_files.push_back(std::move(file));
+	}
+
+	std::vector<char> manifest = createManifest(snapshot);
+	if (!writeBackupFile(
+			 backupDirectory / "snapshots" / fmt::format("{}.pcps", time),
+			 manifest.data(), manifest.size()
+		 )) {
+		log::error("Failed to write the backup snapshot");
+		return;
+	}
+
+	m_lastFiles.clear();
+	for (BackupFile& file : snapshot.m_files)
+		m_lastFiles.emplace(file.m_path, std::move(file));
+
+	log::info(
+		"Backed up {} save files, {} of them changed", m_lastFiles.size(),
+		storedFiles
+	);
+
+	pruneSnapshots(backupDirectory, keepCount);
+}
+
+// Stored files that no kept snapshot has are removed with the old snapshots
+void SaveBackup::pruneSnapshots(
+	const std::filesystem::path& backupDirectory, unsigned int keepCount
+) {
+	std::vector<std::filesystem::path> manifestPaths =
+		getManifestPaths(backupDirectory);
+	if (manifestPaths.size() <= keepCount)
+		return;
+
+	std::error_code error;
+	for (unsigned int i = keepCount; i < manifestPaths.size(); i++)
+		std::filesystem::remove(manifestPaths[i], error);
+	manifestPaths.resize(keepCount);
+
+	std::unordered_set<uint64_t> keptHashes;
+	for (const std::filesystem::path& path : manifestPaths) {
+		std::optional<BackupSnapshot> snapshot = readManifest(path);
+		// Nothing is removed if a kept snapshot can't be read
+		if (!snapshot.has_value())
+			return;
+
+		for (const BackupFile& file : snapshot->m_files)
+			keptHashes.insert(file.m_hash);
+	}
+
+	std::vector<std::filesystem::path> unusedObjects;
+	for (const std::filesystem::directory_entry& object :
+		  std::filesystem::recursive_directory_iterator(
+			  backupDirectory / "objects", error
+		  )) {
+		if (!object.is_regular_file(error))
+			continue;
+
+		uint64_t hash = std::strtoull(
+			string::pathToString(object.path().filename()).c_str(), nullptr, 16
+		);
+		if (!keptHashes.contains(hash))
+			unusedObjects.push_back(object.path());
+	}
+
+	for (const std::filesystem::path& path : unusedObjects)
+		std::filesystem::remove(path, error);
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A save file as it was when a snapshot was taken
+struct BackupFile {
+	// Relative to the save directory
+	std::string m_path;
+	uint64_t m_size = 0;
+	// Only compared with the last snapshot, files with the same size and write
+	// time aren't read again
+	int64_t m_modified = 0;
+	uint64_t m_hash = 0;
+};
+
+struct BackupSnapshot {
+	// Unix time
+	int64_t m_time = 0;
+	std::vector<BackupFile> m_files;
+
+	// Returns nullptr if the file wasn't in the save directory
+	const BackupFile* getFile(const std::filesystem::path& path) const;
+};
+
+// Incremental backups of the save directory, kept in backups/. Every
+// distinct file is stored once in backups/objects under its hash, and a
+// snapshot is a manifest of the files the save directory had. Snapshots are
+// taken on their own thread once the writes queued before them are done, so
+// the save writer never waits for one
+class SaveBackup {
+public:
+	static SaveBackup* get();
+
+	// Takes a snapshot when the last one is older than the backup interval
+	void snapshotIfDue();
+	void snapshot();
+	// Blocks until the requested snapshot is written, must be called before
+	// reading the backups
+	void wait();
+
+	// Newest first
+	std::vector<BackupSnapshot> getSnapshots();
+	// Snapshots that have the save container of the level, newest first
+	std::vector<BackupSnapshot>
+	getLevelSnapshots(const std::filesystem::path& basePath);
+
+	// Replaces the save files of the level with the ones in the snapshot
+	bool restoreLevel(
+		const BackupSnapshot& snapshot, const std::filesystem::path& basePath
+	);
+	// Writes a file of the snapshot somewhere else, for reading it without
+	// touching the level's saves
+	bool extractFile(
+		const BackupFile& file, const std::filesystem::path& path
+	);
+
+	~SaveBackup();
+
+private:
+	struct SnapshotRequest {
+		std::filesystem::path m_savesDirectory;
+		std::filesystem::path m_backupDirectory;
+		int64_t m_time;
+		unsigned int m_keepCount;
+	};
+
+	// Files of the newest snapshot, only used on the backup thread
+	std::unordered_map<std::string, BackupFile> m_lastFiles;
+	bool m_loadedLastFiles = false;
+	// A request made while another one is waiting replaces it
+	std::optional<SnapshotRequest> m_request;
+	std::mutex m_mutex;
+	std::condition_variable m_requestCondition;
+	std::condition_variable m_idleCondition;
+	bool m_busy = false;
+	bool m_stopping = false;
+	std::thread m_thread;
+
+	void run();
+	void takeSnapshot(
+		const std::filesystem::path& savesDirectory,
+		const std::filesystem::path& backupDirectory, int64_t time,
+		unsigned int keepCount
+	);
+	void pruneSnapshots(
+		const std::filesystem::path& backupDirectory, unsigned int keepCount
+	);
+	std::optional<std::vector<char>> readFile(const BackupFile& file);
+};
@@ -0,0 +1,496 @@
+#include "SaveCatalog.hpp"
+#include "ByteBuffer.hpp"
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+#include "SaveArchive.hpp"
+#include "SaveContainer.hpp"
+#include "SavePath.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+#include <Geode/loader/Dispatch.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <numeric>
+
+using namespace geode::prelude;
+
+const char CATALOG_HEADER[] = "PCP CATALOG";
+const unsigned int CATALOG_VERSION = 1;
+
+// Body size and checksum
+const uint64_t CATALOG_RECORD_HEADER_SIZE =
+	sizeof(unsigned int) + sizeof(uint32_t);
+
+// The catalog is rewritten on load once it has this many more records than
+// levels
+const uint64_t MIN_CATALOG_SLACK = 256;
+
+// Files a level can have in the save directories
+const char* const LEVEL_SAVE_EXTENSIONS[] = {
+	".pcpc", ".pcpb", ".pcpq", ".pcpt"
+};
+
+using SaveSummaryFilter =
+	DispatchFilter<GJGameLevel*, bool, unsigned int*, unsigned int*>;
+using SaveSizeFilter = DispatchFilter<GJGameLevel*, bool, uint64_t*>;
+
+$execute {
+	new EventListener<SaveSummaryFilter>(
+		+[](GJGameLevel* level, bool lowDetailMode, unsigned int* layerCount,
+			 unsigned int* checkpointCount) {
+			const CatalogEntry* entry = SaveCatalog::get()->getEntry(
+				getLevelSaveBasePath(level, lowDetailMode)
+			);
+
+			*layerCount = entry != nullptr ? entry->getLayerCount() : 0;
+			*checkpointCount = entry != nullptr ? entry->getCheckpointCount() : 0;
+			return ListenerResult::Stop;
+		},
+		SaveSummaryFilter("get-save-summary"_spr)
+	);
+	new EventListener<SaveSizeFilter>(
+		+[](GJGameLevel* level, bool lowDetailMode, uint64_t* size) {
+			const CatalogEntry* entry = SaveCatalog::get()->getEntry(
+				getLevelSaveBasePath(level, lowDetailMode)
+			);
+
+			*size = entry != nullptr ? entry->getSize() : 0;
+			return ListenerResult::Stop;
+		},
+		SaveSizeFilter("get-save-size"_spr)
+	);
+}
+
+static int64_t getCurrentTime() { return std::time(nullptr); }
+
+unsigned int CatalogEntry::getLayerCount() const {
+	return m_checkpointCounts.size();
+}
+
+unsigned int CatalogEntry::getCheckpointCount() const {
+	return std::accumulate(
+		m_checkpointCounts.begin(), m_checkpointCounts.end(), 0u
+	);
+}
+
+uint64_t CatalogEntry::getSize() const {
+	return m_containerSize + m_blockStoreSize;
+}
+
+bool CatalogEntry::isEmpty() const {
+	return m_checkpointCounts.empty() && getSize() == 0;
+}
+
+SaveCatalog* SaveCatalog::get() {
+	static SaveCatalog catalog;
+	return &catalog;
+}
+
+// The save path without its extension, relative to the saves directory
+std::string SaveCatalog::getKey(const std::filesystem::path& savePath) {
+	std::filesystem::path basePath = savePath;
+	basePath.replace_extension();
+
+	return basePath.lexically_relative(getSavesDirectory()).generic_string();
+}
+
+const CatalogEntry*
+SaveCatalog::getEntry(const std::filesystem::path& savePath) {
+	load();
+
+	auto entry = m_entries.find(getKey(savePath));
+	if (entry == m_entries.end())
+		return nullptr;
+
+	return &entry->second;
+}
+
+const std::unordered_map<std::string, CatalogEntry>&
+SaveCatalog::getEntries() {
+	load();
+	return m_entries;
+}
+
+uint64_t SaveCatalog::getTotalSize() {
+	load();
+	return m_totalSize;
+}
+
+void SaveCatalog::updateContainer(
+	const std::filesystem::path& containerPath,
+	std::vector<unsigned int> checkpointCounts, uint64_t size
+) {
+	load();
+
+	std::string key = getKey(containerPath);
+	CatalogEntry& entry = beginUpdate(key);
+	entry.m_checkpointCounts = std::move(checkpointCounts);
+	entry.m_containerSize = size;
+	entry.m_lastUsed = getCurrentTime();
+
+	writeEntry(key);
+}
+
+void SaveCatalog::updateBlockStore(
+	const std::filesystem::path& blockStorePath, uint64_t size
+) {
+	load();
+
+	std::string key = getKey(blockStorePath);
+	CatalogEntry& entry = beginUpdate(key);
+	entry.m_blockStoreSize = size;
+	entry.m_lastUsed = getCurrentTime();
+
+	writeEntry(key);
+}
+
+void SaveCatalog::markUsed(const std::filesystem::path& savePath) {
+	load();
+
+	std::string key = getKey(savePath);
+	if (!m_entries.contains(key))
+		return;
+
+	beginUpdate(key).m_lastUsed = getCurrentTime();
+	writeEntry(key);
+}
+
+void SaveCatalog::removeLevel(const std::filesystem::path& savePath) {
+	load();
+
+	std::string key = getKey(savePath);
+	if (!m_entries.contains(key))
+		return;
+
+	beginUpdate(key) = CatalogEntry();
+	writeEntry(key);
+}
+
+void SaveCatalog::deleteLevel(const std::filesystem::path& savePath) {
+	SaveWriter::get()->flush();
+
+	removeLevelFiles(getKey(savePath));
+	removeLevel(savePath);
+}
+
+static std::vector<std::string> getPinnedLevels() {
+	return Mod::get()->getSavedValue<std::vector<std::string>>("pinned-levels");
+}
+
+void SaveCatalog::moveLevel(
+	const std::filesystem::path& from, const std::filesystem::path& to
+) {
+	load();
+
+	if (isPinned(from)) {
+		setPinned(from, false);
+		setPinned(to, true);
+	}
+
+	std::string fromKey = getKey(from);
+	std::string toKey = getKey(to);
+	auto entry = m_entries.find(fromKey);
+	if (entry == m_entries.end() || fromKey == toKey)
+		return;
+
+	CatalogEntry movedEntry = entry->second;
+	beginUpdate(fromKey) = CatalogEntry();
+	writeEntry(fromKey);
+	beginUpdate(toKey) = std::move(movedEntry);
+	writeEntry(toKey);
+}
+
+bool SaveCatalog::isPinned(const std::filesystem::path& savePath) {
+	std::vector<std::string> pinnedLevels = getPinnedLevels();
+
+	return std::find(
+				 pinnedLevels.begin(), pinnedLevels.end(), getKey(savePath)
+			 ) != pinnedLevels.end();
+}
+
+void SaveCatalog::setPinned(
+	const std::filesystem::path& savePath, bool pinned
+) {
+	std::vector<std::string> pinnedLevels = getPinnedLevels();
+	std::string key = getKey(savePath);
+
+	std::erase(pinnedLevels, key);
+	if (pinned)
+		pinnedLevels.push_back(key);
+
+	Mod::get()->setSavedValue("pinned-levels", pinnedLevels);
+}
+
+void SaveCatalog::enforceQuota(const std::filesystem::path& keepSavePath) {
+	load();
+
+	uint64_t quota =
+		(uint64_t)Mod::get()->getSettingValue<int64_t>("save-quota") * 1024 *
+		1024;
+	if (quota == 0 || m_totalSize <= quota)
+		return;
+
+	std::string keepKey;
+	if (!keepSavePath.empty())
+		keepKey = getKey(keepSavePath);
+
+	std::vector<std::string> pinnedLevels = getPinnedLevels();
+
+	std::vector<std::pair<int64_t, std::string>> candidates;
+	for (const auto& [key, entry] : m_entries)
+		if (key != keepKey &&
+			 std::find(pinnedLevels.begin(), pinnedLevels.end(), key) ==
+				 pinnedLevels.end())
+			candidates.emplace_back(entry.m_lastUsed, key);
+
+	std::sort(candidates.begin(), candidates.end());
+
+	bool archive =
+		Mod::get()->getSettingValue<std::string>("save-quota-action") ==
+		"Archive";
+
+	for (const auto& [lastUsed, key] : candidates) {
+		if (m_totalSize <= quota)
+			break;
+
+		evictLevel(key, archive);
+	}
+}
+
+// The level's files are only removed once its archive is written
+void SaveCatalog::evictLevel(const std::string& key, bool archive) {
+	std::filesystem::path basePath = getSavesDirectory() / key;
+
+	SaveWriter::get()->flush();
+
+	if (archive && !archiveLevelSaves(basePath, getLevelArchivePath(basePath))) {
+		log::error("Failed to archive the saves of {}", key);
+		return;
+	}
+
+	removeLevelFiles(key);
+
+	log::info(
+		"{} the saves of {} to stay under the storage limit",
+		archive ? "Archived" : "Deleted", key
+	);
+
+	beginUpdate(key) = CatalogEntry();
+	writeEntry(key);
+}
+
+void SaveCatalog::removeLevelFiles(const std::string& key) {
+	std::filesystem::path basePath = getSavesDirectory() / key;
+
+	std::error_code error;
+	for (const char* extension : LEVEL_SAVE_EXTENSIONS) {
+		std::filesystem::path path = basePath;
+		path.concat(extension);
+		std::filesystem::remove(path, error);
+	}
+}
+
+void SaveCatalog::rebuild() {
+	m_path = getSavesDirectory() / "catalog.pcpi";
+	m_loaded = true;
+	m_entries.clear();
+	m_totalSize = 0;
+
+	// File times are only converted through the difference to now, which
+	// works with every standard library
+	auto fileNow = std::filesystem::file_time_type::clock::now();
+	int64_t now = getCurrentTime();
+
+	std::error_code error;
+	for (const char* directory : {"main", "editor"}) {
+		for (const std::filesystem::directory_entry& file :
+			  std::filesystem::recursive_directory_iterator(
+				  getSavesDirectory() / directory, error
+			  )) {
+			if (!file.is_regular_file(error))
+				continue;
+
+			std::filesystem::path extension = file.path().extension();
+			if (extension != ".pcpc" && extension != ".pcpb")
+				continue;
+
+			CatalogEntry entry = m_entries[getKey(file.path())];
+
+			if (extension == ".pcpc") {
+				// Only read, damaged containers are left for when the level is
+				// played
+				SaveContainer container;
+				container.load(file.path(), true);
+
+				entry.m_checkpointCounts.clear();
+				for (unsigned int i = 0; i < container.getLayerCount(); i++)
+					entry.m_checkpointCounts.push_back(
+						container.getLayer(i)->m_info.m_checkpointCount
+					);
+				entry.m_containerSize = container.getSize();
+			} else
+				entry.m_blockStoreSize = file.file_size(error);
+
+			std::filesystem::file_time_type writeTime =
+				file.last_write_time(error);
+			if (!error) {
+				int64_t age = std::chrono::duration_cast<std::chrono::seconds>(
+									  fileNow - writeTime
+								  )
+									  .count();
+				entry.m_lastUsed = std::max(entry.m_lastUsed, now - age);
+			}
+
+			m_entries[getKey(file.path())] = std::move(entry);
+		}
+	}
+
+	for (const auto& [key, entry] : m_entries)
+		m_totalSize += entry.getSize();
+
+	writeCatalog();
+}
+
+void SaveCatalog::load() {
+	if (m_loaded)
+		return;
+
+	m_loaded = true;
+	m_path = getSavesDirectory() / "catalog.pcpi";
+
+	SaveWriter::get()->flush();
+
+	MappedFile catalog;
+	if (!catalog.open(m_path)) {
+		rebuild();
+		return;
+	}
+
+	ByteReader reader = catalog.reader();
+
+	char header[sizeof(CATALOG_HEADER)];
+	unsigned int version;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version) ||
+		 std::memcmp(header, CATALOG_HEADER, sizeof(header)) != 0 ||
+		 version != CATALOG_VERSION) {
+		catalog.close();
+		rebuild();
+		return;
+	}
+
+	bool damaged = false;
+	while (reader.remaining() > 0) {
+		unsigned int size;
+		uint32_t checksum;
+		if (!reader.read(size) || !reader.read(checksum) ||
+			 size > reader.remaining()) {
+			damaged = true;
+			break;
+		}
+
+		ByteReader record(reader.data() + reader.position(), size);
+		reader.skip(size);
+
+		if (crc32c(record.data(), size) != checksum) {
+			damaged = true;
+			break;
+		}
+
+		uint16_t keySize;
+		unsigned int layerCount;
+		std::string key;
+		CatalogEntry entry;
+		if (!record.read(keySize) || keySize > record.remaining()) {
+			damaged = true;
+			break;
+		}
+
+		key.assign(record.data() + record.position(), keySize);
+		record.skip(keySize);
+
+		if (!record.read(entry.m_containerSize) ||
+			 !record.read(entry.m_blockStoreSize) ||
+			 !record.read(entry.m_lastUsed) || !record.read(layerCount) ||
+			 !record.readArray(entry.m_checkpointCounts, layerCount)) {
+			damaged = true;
+			break;
+		}
+
+		if (entry.isEmpty())
+			m_entries.erase(key);
+		else
+			m_entries[key] = std::move(entry);
+
+		m_recordCount++;
+	}
+
+	catalog.close();
+
+	for (const auto& [key, entry] : m_entries)
+		m_totalSize += entry.getSize();
+
+	// The catalog can always be rebuilt, so damage isn't worth recovering
+	// from
+	if (damaged) {
+		log::warn("Save catalog is damaged, rebuilding it");
+		rebuild();
+	} else if (m_recordCount > m_entries.size() * 2 + MIN_CATALOG_SLACK)
+		writeCatalog();
+}
+
+// The entry's size is taken out of the total until it's written
+CatalogEntry& SaveCatalog::beginUpdate(const std::string& key) {
+	CatalogEntry& entry = m_entries[key];
+	m_totalSize -= entry.getSize();
+
+	return entry;
+}
+
+void SaveCatalog::writeEntry(const std::string& key) {
+	CatalogEntry& entry = m_entries[key];
+	m_totalSize += entry.getSize();
+
+	std::vector<char> record;
+	appendEntryRecord(record, key, entry);
+
+	if (entry.isEmpty())
+		m_entries.erase(key);
+
+	m_recordCount++;
+	SaveWriter::get()->append(m_path, std::move(record));
+}
+
+void SaveCatalog::writeCatalog() {
+	std::vector<char> catalog(
+		CATALOG_HEADER, CATALOG_HEADER + sizeof(CATALOG_HEADER)
+	);
+	appendValue(catalog, CATALOG_VERSION);
+
+	for (const auto& [key, entry] : m_entries)
+		appendEntryRecord(catalog, key, entry);
+
+	m_recordCount = m_entries.size();
+	SaveWriter::get()->write(m_path, std::move(catalog));
+}
+
+void SaveCatalog::appendEntryRecord(
+	std::vector<char>& buffer, const std::string& key,
+	const CatalogEntry& entry
+) {
+	std::vector<char> record;
+	appendValue(record, (uint16_t)key.size());
+	record.insert(record.end(), key.begin(), key.end());
+	appendValue(record, entry.m_containerSize);
+	appendValue(record, entry.m_blockStoreSize);
+	appendValue(record, entry.m_lastUsed);
+	appendValue(record, (unsigned int)entry.m_checkpointCounts.size());
+	for (unsigned int checkpointCount : entry.m_checkpointCounts)
+		appendValue(record, checkpointCount);
+
+	appendValue(buffer, (unsigned int)record.size());
+	appendValue(buffer, crc32c(record.data(), record.size()));
+	buffer.insert(buffer.end(), record.begin(), record.end());
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// What the catalog knows about the saves of a level (or of its low detail
+// variant)
+struct CatalogEntry {
+	// Checkpoint count of every layer, in layer order
+	std::vector<unsigned int> m_checkpointCounts;
+	uint64_t m_containerSize = 0;
+	uint64_t m_blockStoreSize = 0;
+	// Unix time
+	int64_t m_lastUsed = 0;
+
+	unsigned int getLayerCount() const;
+	unsigned int getCheckpointCount() const;
+	uint64_t getSize() const;
+	bool isEmpty() const;
+};
+
+// Index of every level with saves, kept in saves/catalog.pcpi so nothing has
+// to open save files to know what's saved. The file is a journal of entry
+// updates, the last one of each level wins. It is rebuilt from the save
+// directories when it's missing or damaged.
+//
+// Other mods can ask for a level's layer and checkpoint count with
+// DispatchEvent<GJGameLevel*, bool, unsigned int*, unsigned int*>(
+// 	"kevadroz.practicecheckpointpermanence/get-save-summary", level,
+// 	lowDetailMode, &layerCount, &checkpointCount
+// ).post();
+// and for the bytes its saves take on disk with
+// DispatchEvent<GJGameLevel*, bool, uint64_t*>(
+// 	"kevadroz.practicecheckpointpermanence/get-save-size", level,
+// 	lowDetailMode, &size
+// ).post();
+class SaveCatalog {
+public:
+	static SaveCatalog* get();
+
+	// Levels are looked up with the path of any of their save files
+	static std::string getKey(const std::filesystem::path& savePath);
+
+	// Returns nullptr if the level has no saves
+	const CatalogEntry* getEntry(const std::filesystem::path& savePath);
+	const std::unordered_map<std::string, CatalogEntry>& getEntries();
+	uint64_t getTotalSize();
+
+	void updateContainer(
+		const std::filesystem::path& containerPath,
+		std::vector<unsigned int> checkpointCounts, uint64_t size
+	);
+	void updateBlockStore(
+		const std::filesystem::path& blockStorePath, uint64_t size
+	);
+	void markUsed(const std::filesystem::path& savePath);
+	void removeLevel(const std::filesystem::path& savePath);
+	// Deletes every save file of the level and removes it from the catalog
+	void deleteLevel(const std::filesystem::path& savePath);
+	// For when the save files of a level are moved, keeps the pin too
+	void moveLevel(
+		const std::filesystem::path& from, const std::filesystem::path& to
+	);
+
+	// Pinned levels are never evicted. Pins are kept in the mod's saved
+	// values, so they survive a rebuild of the catalog
+	bool isPinned(const std::filesystem::path& savePath);
+	void setPinned(const std::filesystem::path& savePath, bool pinned);
+
+	// Archives or deletes the saves of the least recently used levels until
+	// everything fits in the storage limit. The level with keepSavePath is
+	// left alone
+	void enforceQuota(const std::filesystem::path& keepSavePath = {});
+
+	// Scans the save directories and writes the catalog again
+	void rebuild();
+
+private:
+	std::filesystem::path m_path;
+	std::unordered_map<std::string, CatalogEntry> m_entries;
+	uint64_t m_recordCount = 0;
+	uint64_t m_totalSize = 0;
+	bool m_loaded = false;
+
+	void load();
+	CatalogEntry& beginUpdate(const std::string& key);
+	void writeEntry(const std::string& key);
+	void evictLevel(const std::string& key, bool archive);
+	void removeLevelFiles(const std::string& key);
+	void writeCatalog();
+	void appendEntryRecord(
+		std::vector<char>& buffer, const std::string& key,
+		const CatalogEntry& entry
+	);
+};
@@ -0,0 +1,458 @@
+#include "SaveContainer.hpp"
+#include "Checksum.hpp"
+#include "Quarantine.hpp"
+#include "SaveCatalog.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <cstring>
+#include <unordered_map>
+
+using namespace geode::prelude;
+
+const char CONTAINER_HEADER[] = "PCP CONTAINER";
+const unsigned int CONTAINER_VERSION = 2;
+const uint64_t CONTAINER_HEADER_SIZE =
+	sizeof(CONTAINER_HEADER) + sizeof(CONTAINER_VERSION);
+
+// Layer key and data size
+const uint64_t CHUNK_FRAME_SIZE = sizeof(unsigned int) + sizeof(uint64_t);
+// Version 2 chunks also have a checksum of the frame, and of the data for
+// tables. Layer data is checked record by record by the journal instead
+const uint64_t CHUNK_HEADER_SIZE = CHUNK_FRAME_SIZE + sizeof(uint32_t);
+// Chunks with this key hold a layer table
+const unsigned int TABLE_KEY = 0;
+
+// The container is compacted once dead chunks take more space than both
+// this and the live ones
+const uint64_t MIN_CONTAINER_SLACK = 1024 * 1024;
+
+// Covers the frame, and the data for tables
+static uint32_t
+getChunkChecksum(unsigned int key, const char* frame, const char* data) {
+	uint32_t checksum = crc32c(frame, CHUNK_FRAME_SIZE);
+	if (key != TABLE_KEY)
+		return checksum;
+
+	uint64_t size;
+	std::memcpy(&size, frame + sizeof(key), sizeof(size));
+	return crc32c(data, size, checksum);
+}
+
+LayerView::LayerView(const MappedFile& file, const ContainerLayer& layer)
+	: m_data(file.data()), m_fileSize(file.size()), m_chunks(layer.m_chunks) {}
+
+const char* LayerView::get(uint64_t offset, uint64_t size) const {
+	for (const ContainerChunk& chunk : m_chunks) {
+		if (offset < chunk.m_layerOffset ||
+			 offset >= chunk.m_layerOffset + chunk.m_size)
+			continue;
+
+		uint64_t chunkOffset = offset - chunk.m_layerOffset;
+		if (size > chunk.m_size - chunkOffset ||
+			 chunk.m_fileOffset + chunk.m_size > m_fileSize)
+			return nullptr;
+
+		return m_data + chunk.m_fileOffset + chunkOffset;
+	}
+
+	return nullptr;
+}
+
+const std::vector<ContainerChunk>& LayerView::getChunks() const {
+	return m_chunks;
+}
+
+ByteReader LayerView::getChunkReader(const ContainerChunk& chunk) const {
+	if (chunk.m_fileOffset + chunk.m_size > m_fileSize)
+		return ByteReader(nullptr, 0);
+
+	return ByteReader(m_data + chunk.m_fileOffset, chunk.m_size);
+}
+
+void SaveContainer::load(const std::filesystem::path& path, bool readOnly) {
+	clear();
+	m_path = path;
+
+	SaveWriter::get()->flush();
+
+	MappedFile container;
+	if (!container.open(path))
+		return;
+
+	ByteReader reader = container.reader();
+
+	char header[sizeof(CONTAINER_HEADER)];
+	unsigned int version;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version) ||
+		 std::memcmp(header, CONTAINER_HEADER, sizeof(header)) != 0 ||
+		 version < 1 || version > CONTAINER_VERSION) {
+		log::error("Invalid save container {}", string::pathToString(path));
+		m_readOnly = true;
+		return;
+	}
+
+	std::unordered_map<unsigned int, std::vector<ContainerChunk>> chunks;
+	ByteReader table(nullptr, 0);
+
+	bool checksummed = version >= 2;
+	uint64_t headerSize = checksummed ? CHUNK_HEADER_SIZE : CHUNK_FRAME_SIZE;
+
+	uint64_t position = reader.position();
+	while (reader.remaining() >= headerSize) {
+		unsigned int key;
+		uint64_t size;
+		uint32_t checksum = 0;
+		reader.read(key);
+		reader.read(size);
+		if (checksummed)
+			reader.read(checksum);
+
+		if (size > reader.remaining())
+			break;
+
+		uint64_t dataOffset = reader.position();
+		reader.skip(size);
+
+		if (checksummed &&
+			 checksum != getChunkChecksum(
+								 key, container.data() + position,
+								 container.data() + dataOffset
+							 ))
+			break;
+
+		if (key == TABLE_KEY) {
+			table = ByteReader(container.data() + dataOffset, size);
+			m_tableSize = CHUNK_HEADER_SIZE + size;
+		} else {
+			std::vector<ContainerChunk>& layerChunks = chunks[key];
+
+			uint64_t layerOffset = 0;
+			if (!layerChunks.empty())
+				layerOffset =
+					layerChunks.back().m_layerOffset + layerChunks.back().m_size;
+
+			layerChunks.push_back({dataOffset, layerOffset, size});
+			m_nextKey = std::max(m_nextKey, key + 1);
+		}
+
+		position = reader.position();
+	}
+
+	unsigned int nextKey;
+	unsigned int layerCount;
+	if (table.read(nextKey) && table.read(layerCount)) {
+		m_nextKey = std::max(m_nextKey, nextKey);
+
+		for (unsigned int i = layerCount; i > 0; i--) {
+			ContainerLayer layer;
+			if (!table.read(layer.m_key) || !table.read(layer.m_info.m_version) ||
+				 !table.read(layer.m_info.m_platform) ||
+				 !table.read(layer.m_info.m_levelIdentifier) ||
+				 !table.read(layer.m_info.m_checkpointCount))
+				break;
+
+			layer.m_chunks = chunks[layer.m_key];
+			if (!layer.m_chunks.empty())
+				layer.m_size = layer.m_chunks.back().m_layerOffset +
+									layer.m_chunks.back().m_size;
+
+			m_layers.push_back(layer);
+		}
+	}
+
+	// A chunk that was cut short by a crash or damaged on disk ends the
+	// container. Everything from there is kept aside and cut off, so new
+	// chunks don't end up after it
+	uint64_t containerSize = container.size();
+	if (position < containerSize && !readOnly)
+		quarantineData(
+			getQuarantinePath(), container.data() + position,
+			containerSize - position
+		);
+
+	container.close();
+
+	m_size = position;
+
+	if (readOnly) {
+		m_readOnly = true;
+		return;
+	}
+
+	if (position < containerSize) {
+		SaveWriter::get()->flush();
+		std::filesystem::resize_file(path, position);
+	}
+
+	if (version < CONTAINER_VERSION)
+		compact();
+}
+
+bool SaveContainer::isLoaded() { return !m_path.empty(); }
+
+void SaveContainer::clear() {
+	m_path.clear();
+	m_layers.clear();
+	m_nextKey = 1;
+	m_size = 0;
+	m_tableSize = 0;
+	m_readOnly = false;
+}
+
+void SaveContainer::create(
+	const std::filesystem::path& path, std::vector<std::vector<char>> layerData,
+	std::vector<SaveLayerInfo> layerInfos
+) {
+	clear();
+	m_path = path;
+
+	std::vector<char> container(
+		CONTAINER_HEADER, CONTAINER_HEADER + sizeof(CONTAINER_HEADER)
+	);
+	appendValue(container, CONTAINER_VERSION);
+
+	for (unsigned int i = 0; i < layerData.size(); i++) {
+		ContainerLayer layer;
+		layer.m_key = m_nextKey++;
+		layer.m_info = layerInfos[i];
+		layer.m_chunks.push_back(
+			{container.size() + CHUNK_HEADER_SIZE, 0, layerData[i].size()}
+		);
+		layer.m_size = layerData[i].size();
+
+		appendChunk(container, layer.m_key, layerData[i]);
+		m_layers.push_back(layer);
+	}
+
+	std::vector<char> table = createTable();
+	m_tableSize = CHUNK_HEADER_SIZE + table.size();
+	appendChunk(container, TABLE_KEY, table);
+
+	m_size = container.size();
+	SaveWriter::get()->write(m_path, std::move(container));
+
+	updateCatalog();
+}
+
+const std::filesystem::path& SaveContainer::getPath() { return m_path; }
+
+std::filesystem::path SaveContainer::getQuarantinePath() {
+	std::filesystem::path quarantinePath = m_path;
+	quarantinePath.replace_extension(".pcpq");
+
+	return quarantinePath;
+}
+
+uint64_t SaveContainer::getSize() { return m_size; }
+
+unsigned int SaveContainer::getLayerCount() { return m_layers.size(); }
+
+const ContainerLayer* SaveContainer::getLayer(unsigned int index) {
+	if (index >= m_layers.size())
+		return nullptr;
+
+	return &m_layers[index];
+}
+
+uint64_t SaveContainer::getFileOffset(
+	unsigned int index, uint64_t offset, uint64_t size
+) {
+	if (index >= m_layers.size())
+		return 0;
+
+	for (const ContainerChunk& chunk : m_layers[index].m_chunks)
+		if (offset >= chunk.m_layerOffset &&
+			 offset - chunk.m_layerOffset + size <= chunk.m_size)
+			return chunk.m_fileOffset + offset - chunk.m_layerOffset;
+
+	return 0;
+}
+
+// The data goes in a chunk with a new key, so the old data stays valid until
+// the table that points to the new key is written
+void SaveContainer::writeLayer(
+	unsigned int index, std::vector<char> data, const SaveLayerInfo& info
+) {
+	if (m_readOnly || index > m_layers.size())
+		return;
+
+	if (index == m_layers.size())
+		m_layers.push_back({});
+
+	ContainerLayer& layer = m_layers[index];
+	layer.m_key = m_nextKey++;
+	layer.m_info = info;
+	layer.m_size = data.size();
+	layer.m_chunks.clear();
+
+	std::vector<char> chunk;
+	if (m_size == 0) {
+		chunk.insert(
+			chunk.end(), CONTAINER_HEADER,
+			CONTAINER_HEADER + sizeof(CONTAINER_HEADER)
+		);
+		appendValue(chunk, CONTAINER_VERSION);
+	}
+
+	layer.m_chunks.push_back(
+		{m_size + chunk.size() + CHUNK_HEADER_SIZE, 0, data.size()}
+	);
+	appendChunk(chunk, layer.m_key, data);
+
+	m_size += chunk.size();
+	SaveWriter::get()->append(m_path, std::move(chunk));
+
+	writeTable();
+}
+
+void SaveContainer::appendToLayer(unsigned int index, std::vector<char> data) {
+	if (m_readOnly || index >= m_layers.size())
+		return;
+
+	ContainerLayer& layer = m_layers[index];
+	layer.m_chunks.push_back(
+		{m_size + CHUNK_HEADER_SIZE, layer.m_size, data.size()}
+	);
+	layer.m_size += data.size();
+
+	std::vector<char> chunk;
+	appendChunk(chunk, layer.m_key, data);
+
+	m_size += chunk.size();
+	SaveWriter::get()->append(m_path, std::move(chunk));
+
+	updateCatalog();
+}
+
+void SaveContainer::setLayerInfo(
+	unsigned int index, const SaveLayerInfo& info
+) {
+	if (m_readOnly || index >= m_layers.size())
+		return;
+
+	m_layers[index].m_info = info;
+	writeTable();
+}
+
+void SaveContainer::removeLayer(unsigned int index) {
+	if (m_readOnly || index >= m_layers.size())
+		return;
+
+	m_layers.erase(m_layers.begin() + index);
+	writeTable();
+}
+
+void SaveContainer::swapLayers(unsigned int left, unsigned int right) {
+	if (m_readOnly || left >= m_layers.size() || right >= m_layers.size())
+		return;
+
+	std::swap(m_layers[left], m_layers[right]);
+	writeTable();
+}
+
+void SaveContainer::appendChunk(
+	std::vector<char>& buffer, unsigned int key, const std::vector<char>& data
+) {
+	uint64_t chunkOffset = buffer.size();
+	appendValue(buffer, key);
+	appendValue(buffer, (uint64_t)data.size());
+	appendValue(
+		buffer, getChunkChecksum(key, buffer.data() + chunkOffset, data.data())
+	);
+	buffer.insert(buffer.end(), data.begin(), data.end());
+}
+
+
+std::vector<char> SaveContainer::createTable() {
+	std::vector<char> table;
+	appendValue(table, m_nextKey);
+	appendValue(table, (unsigned int)m_layers.size());
+
+	for (const ContainerLayer& layer : m_layers) {
+		appendValue(table, layer.m_key);
+		appendValue(table, layer.m_info.m_version);
+		appendValue(table, layer.m_info.m_platform);
+		appendValue(table, layer.m_info.m_levelIdentifier);
+		appendValue(table, layer.m_info.m_checkpointCount);
+	}
+
+	return table;
+}
+
+void SaveContainer::writeTable() {
+	std::vector<char> chunk;
+	if (m_size == 0) {
+		chunk.insert(
+			chunk.end(), CONTAINER_HEADER,
+			CONTAINER_HEADER + sizeof(CONTAINER_HEADER)
+		);
+		appendValue(chunk, CONTAINER_VERSION);
+	}
+
+	std::vector<char> table = createTable();
+	m_tableSize = CHUNK_HEADER_SIZE + table.size();
+	appendChunk(chunk, TABLE_KEY, table);
+
+	m_size += chunk.size();
+	SaveWriter::get()->append(m_path, std::move(chunk));
+
+	updateCatalog();
+	compactIfNeeded();
+}
+
+void SaveContainer::updateCatalog() {
+	std::vector<unsigned int> checkpointCounts;
+	for (const ContainerLayer& layer : m_layers)
+		checkpointCounts.push_back(layer.m_info.m_checkpointCount);
+
+	SaveCatalog::get()->updateContainer(
+		m_path, std::move(checkpointCounts), m_size
+	);
+}
+
+uint64_t SaveContainer::getLiveSize() {
+	uint64_t liveSize = CONTAINER_HEADER_SIZE + m_tableSize;
+	for (const ContainerLayer& layer : m_layers)
+		liveSize += CHUNK_HEADER_SIZE * layer.m_chunks.size() + layer.m_size;
+
+	return liveSize;
+}
+
+void SaveContainer::compactIfNeeded() {
+	uint64_t liveSize = getLiveSize();
+	if (m_size - liveSize > std::max(liveSize, MIN_CONTAINER_SLACK))
+		compact();
+}
+
+// Rewrites the container with every layer in a single chunk. Offsets inside
+// the layers stay the same, so nothing that points into them changes
+void SaveContainer::compact() {
+	SaveWriter::get()->flush();
+
+	MappedFile previousContainer;
+	if (!previousContainer.open(m_path))
+		return;
+
+	std::vector<std::vector<char>> layerData;
+	std::vector<SaveLayerInfo> layerInfos;
+	for (const ContainerLayer& layer : m_layers) {
+		LayerView view(previousContainer, layer);
+
+		std::vector<char> data;
+		data.reserve(layer.m_size);
+		for (const ContainerChunk& chunk : view.getChunks()) {
+			ByteReader reader = view.getChunkReader(chunk);
+			data.insert(data.end(), reader.data(), reader.data() + reader.size());
+		}
+
+		layerData.push_back(std::move(data));
+		layerInfos.push_back(layer.m_info);
+	}
+
+	previousContainer.close();
+
+	std::filesystem::path path = m_path;
+	create(path, std::move(layerData), std::move(layerInfos));
+}
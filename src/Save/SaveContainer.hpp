@@ -0,0 +1,107 @@
+#pragma once
+#include "ByteBuffer.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Header of a save layer as it was last written, so layers can be counted
+// and inspected without reading them
+struct SaveLayerInfo {
+	unsigned int m_version = 0;
+	char m_platform = 0;
+	// Level version for online levels, level string hash for editor levels
+	uint64_t m_levelIdentifier = 0;
+	unsigned int m_checkpointCount = 0;
+};
+
+// Part of a layer stored in one piece, records never span two chunks
+struct ContainerChunk {
+	uint64_t m_fileOffset;
+	uint64_t m_layerOffset;
+	uint64_t m_size;
+};
+
+struct ContainerLayer {
+	unsigned int m_key;
+	SaveLayerInfo m_info;
+	std::vector<ContainerChunk> m_chunks;
+	uint64_t m_size = 0;
+};
+
+// A layer's chunks inside a mapping of the container
+class LayerView {
+public:
+	LayerView() = default;
+	LayerView(const MappedFile& file, const ContainerLayer& layer);
+
+	// Returns nullptr if the range isn't inside a single chunk
+	const char* get(uint64_t offset, uint64_t size) const;
+	const std::vector<ContainerChunk>& getChunks() const;
+	ByteReader getChunkReader(const ContainerChunk& chunk) const;
+
+private:
+	const char* m_data = nullptr;
+	uint64_t m_fileSize = 0;
+	std::vector<ContainerChunk> m_chunks;
+};
+
+// Every save layer of a level lives in one file. The file is a log of
+// chunks tagged with the key of the layer they belong to, and of layer
+// tables that give the order of the layers. The last table wins, so
+// removing, reordering or replacing a layer only appends a new table
+class SaveContainer {
+public:
+	// Read only containers are never written to, not even to repair them
+	void load(const std::filesystem::path& path, bool readOnly = false);
+	bool isLoaded();
+	// Forgets every layer, for when the container was deleted
+	void clear();
+	// Writes a whole new container at once
+	void create(
+		const std::filesystem::path& path,
+		std::vector<std::vector<char>> layerData,
+		std::vector<SaveLayerInfo> layerInfos
+	);
+
+	const std::filesystem::path& getPath();
+	uint64_t getSize();
+	// Where damaged parts of the level's saves are kept
+	std::filesystem::path getQuarantinePath();
+	unsigned int getLayerCount();
+	// Returns nullptr if the layer doesn't exist
+	const ContainerLayer* getLayer(unsigned int index);
+	// Returns 0 if the range isn't inside a single chunk of the layer
+	uint64_t getFileOffset(unsigned int index, uint64_t offset, uint64_t size);
+
+	// Replaces the layer's data, a layer right after the last one is created
+	void writeLayer(
+		unsigned int index, std::vector<char> data, const SaveLayerInfo& info
+	);
+	void appendToLayer(unsigned int index, std::vector<char> data);
+	void setLayerInfo(unsigned int index, const SaveLayerInfo& info);
+	void removeLayer(unsigned int index);
+	void swapLayers(unsigned int left, unsigned int right);
+	// Reports the layers and size of the container to the catalog
+	void updateCatalog();
+
+private:
+	std::filesystem::path m_path;
+	std::vector<ContainerLayer> m_layers;
+	unsigned int m_nextKey = 1;
+	uint64_t m_size = 0;
+	uint64_t m_tableSize = 0;
+	// Containers from other versions are left alone
+	bool m_readOnly = false;
+
+	void appendChunk(
+		std::vector<char>& buffer, unsigned int key,
+		const std::vector<char>& data
+	);
+	std::vector<char> createTable();
+	void writeTable();
+	uint64_t getLiveSize();
+	void compactIfNeeded();
+	void compact();
+};
@@ -0,0 +1,212 @@
+#include "SaveJournal.hpp"
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+// The body size and checksum are filled in by endRecord once the body is
+// written
+static uint64_t beginRecord(std::vector<char>& buffer, JournalRecord type) {
+	uint64_t recordOffset = buffer.size();
+	appendValue(buffer, type);
+	buffer.resize(buffer.size() + RECORD_HEADER_SIZE - sizeof(type));
+
+	return recordOffset;
+}
+
+void endRecord(std::vector<char>& buffer, uint64_t recordOffset) {
+	char* frame = buffer.data() + recordOffset;
+	uint64_t bodySize = buffer.size() - recordOffset - RECORD_HEADER_SIZE;
+	std::memcpy(frame + sizeof(JournalRecord), &bodySize, sizeof(bodySize));
+
+	uint32_t checksum = getRecordChecksum(frame, frame + RECORD_HEADER_SIZE);
+	std::memcpy(frame + RECORD_FRAME_SIZE, &checksum, sizeof(checksum));
+}
+
+static uint64_t appendCheckpointRecord(
+	std::vector<char>& buffer, unsigned int id, CCPoint objectPos, double time,
+	double percent, PayloadEncoding payloadEncoding, uint64_t payloadRawSize,
+	const char* payload, uint64_t payloadSize
+) {
+	bool encoded = payloadEncoding != PayloadEncoding::Raw;
+
+	uint64_t recordOffset = beginRecord(
+		buffer,
+		encoded ? JournalRecord::EncodedCheckpoint : JournalRecord::Checkpoint
+	);
+	appendValue(buffer, id);
+	appendValue(buffer, objectPos);
+	appendValue(buffer, time);
+	appendValue(buffer, percent);
+	if (encoded) {
+		appendValue(buffer, payloadEncoding);
+		appendValue(buffer, payloadRawSize);
+	}
+
+	uint64_t payloadOffset = buffer.size();
+	buffer.insert(buffer.end(), payload, payload + payloadSize);
+
+	endRecord(buffer, recordOffset);
+	return payloadOffset;
+}
+
+uint64_t appendCheckpointRecord(
+	std::vector<char>& buffer, PersistentCheckpoint* checkpoint,
+	const char* payload, uint64_t payloadSize
+) {
+	return appendCheckpointRecord(
+		buffer, checkpoint->m_id, checkpoint->m_objectPos, checkpoint->m_time,
+		checkpoint->m_percent, checkpoint->m_payloadEncoding,
+		checkpoint->m_payloadRawSize, payload, payloadSize
+	);
+}
+
+uint64_t appendCheckpointRecord(
+	std::vector<char>& buffer, const JournalEntry& entry, const char* payload
+) {
+	return appendCheckpointRecord(
+		buffer, entry.m_id, entry.m_objectPos, entry.m_time, entry.m_percent,
+		entry.m_payloadEncoding, entry.m_payloadRawSize, payload,
+		entry.m_payloadSize
+	);
+}
+
+void appendDictionaryRecord(
+	std::vector<char>& buffer, const std::vector<char>& dictionary
+) {
+	uint64_t recordOffset = beginRecord(buffer, JournalRecord::Dictionary);
+	buffer.insert(buffer.end(), dictionary.begin(), dictionary.end());
+	endRecord(buffer, recordOffset);
+}
+
+void appendBaselineRecord(
+	std::vector<char>& buffer, const std::vector<char>& baseline
+) {
+	uint64_t recordOffset = beginRecord(buffer, JournalRecord::Baseline);
+	buffer.insert(buffer.end(), baseline.begin(), baseline.end());
+	endRecord(buffer, recordOffset);
+}
+
+void appendRemoveRecord(std::vector<char>& buffer, unsigned int id) {
+	uint64_t recordOffset = beginRecord(buffer, JournalRecord::Remove);
+	appendValue(buffer, id);
+	endRecord(buffer, recordOffset);
+}
+
+void appendOrderRecord(
+	std::vector<char>& buffer, const CheckpointStore& store
+) {
+	unsigned int checkpointCount = store.count();
+
+	uint64_t recordOffset = beginRecord(buffer, JournalRecord::Order);
+	appendValue(buffer, checkpointCount);
+	for (PersistentCheckpoint* checkpoint : store)
+		appendValue(buffer, checkpoint->m_id);
+	endRecord(buffer, recordOffset);
+}
+
+uint64_t getCheckpointRecordSize(PersistentCheckpoint* checkpoint) {
+	uint64_t metaSize = CHECKPOINT_META_SIZE;
+	if (checkpoint->m_payloadEncoding != PayloadEncoding::Raw)
+		metaSize = ENCODED_CHECKPOINT_META_SIZE;
+
+	return RECORD_HEADER_SIZE + metaSize + checkpoint->m_payloadSize;
+}
+
+uint64_t getOrderRecordSize(unsigned int checkpointCount) {
+	return RECORD_HEADER_SIZE + sizeof(unsigned int) * (checkpointCount + 1);
+}
+
+uint32_t getRecordChecksum(const char* frame, const char* body) {
+	uint64_t bodySize;
+	std::memcpy(&bodySize, frame + sizeof(JournalRecord), sizeof(bodySize));
+
+	uint32_t checksum = crc32c(frame, RECORD_FRAME_SIZE);
+	return crc32c(body, bodySize, checksum);
+}
+
+JournalReplay::JournalReplay(bool platformer) : m_platformer(platformer) {}
+
+void JournalReplay::add(JournalEntry entry) {
+	m_indices[entry.m_id] = m_entries.size();
+	m_entries.push_back(std::move(entry));
+	m_removed.push_back(false);
+}
+
+void JournalReplay::remove(unsigned int id) {
+	auto index = m_indices.find(id);
+	if (index == m_indices.end())
+		return;
+
+	m_removed[index->second] = true;
+	m_indices.erase(index);
+}
+
+void JournalReplay::order(const std::vector<unsigned int>& ids) {
+	std::vector<JournalEntry> orderedEntries;
+	orderedEntries.reserve(ids.size());
+
+	for (unsigned int id : ids) {
+		auto index = m_indices.find(id);
+		if (index == m_indices.end())
+			continue;
+
+		orderedEntries.push_back(std::move(m_entries[index->second]));
+		m_indices.erase(index);
+	}
+
+	m_entries = std::move(orderedEntries);
+	m_orderedCount = m_entries.size();
+	m_removed.assign(m_entries.size(), false);
+
+	m_indices.clear();
+	for (size_t i = 0; i < m_entries.size(); i++)
+		m_indices[m_entries[i].m_id] = i;
+}
+
+std::vector<JournalEntry> JournalReplay::finish() {
+	// The ordered checkpoints don't have to be sorted, so the first one further
+	// than a key is found through the highest key up to each of them
+	std::vector<double> highestKeys;
+	highestKeys.reserve(m_orderedCount);
+	double highestKey = -std::numeric_limits<double>::infinity();
+	for (size_t i = 0; i < m_orderedCount; i++) {
+		highestKey = std::max(highestKey, getKey(m_entries[i]));
+		highestKeys.push_back(highestKey);
+	}
+
+	// Ordered checkpoint they go before, whether they were added after the
+	// order, key and the index that keeps checkpoints with the same key in the
+	// order they were added
+	std::vector<std::tuple<size_t, bool, double, size_t>> placements;
+	placements.reserve(m_entries.size());
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		if (m_removed[i])
+			continue;
+
+		if (i < m_orderedCount) {
+			placements.emplace_back(i, true, 0.0, i);
+			continue;
+		}
+
+		double key = getKey(m_entries[i]);
+		size_t slot = std::upper_bound(
+								highestKeys.begin(), highestKeys.end(), key
+							) -
+							highestKeys.begin();
+		placements.emplace_back(slot, false, key, i);
+	}
+	std::sort(placements.begin(), placements.end());
+
+	std::vector<JournalEntry> entries;
+	entries.reserve(placements.size());
+	for (const auto& placement : placements)
+		entries.push_back(std::move(m_entries[std::get<3>(placement)]));
+
+	return entries;
+}
+
+double JournalReplay::getKey(const JournalEntry& entry) const {
+	return m_platformer ? entry.m_time : entry.m_percent;
+}
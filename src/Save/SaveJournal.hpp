@@ -0,0 +1,102 @@
+#pragma once
+#include "../CheckpointStore.hpp"
+#include "../PersistentCheckpoint.hpp"
+#include "ByteBuffer.hpp"
+#include "Compression.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+// Save layers are journals: checkpoints are appended as records and
+// removals and reorders are written as small records after them
+enum class JournalRecord : char {
+	Checkpoint = 1,
+	Remove = 2,
+	Order = 3,
+	EncodedCheckpoint = 4,
+	// Only written right after the header
+	Dictionary = 5,
+	// Only written after the header and the dictionary
+	Baseline = 6,
+};
+
+// Record type and body size
+const uint64_t RECORD_FRAME_SIZE = sizeof(JournalRecord) + sizeof(uint64_t);
+// Since version 7 records also have a checksum of the frame and the body
+const uint64_t RECORD_HEADER_SIZE = RECORD_FRAME_SIZE + sizeof(uint32_t);
+const unsigned int CHECKSUMMED_RECORDS_VERSION = 7;
+// Checkpoint ID, position, time and percent
+const uint64_t CHECKPOINT_META_SIZE =
+	sizeof(unsigned int) + sizeof(CCPoint) + sizeof(double) * 2;
+// Also has the payload encoding and its decompressed size
+const uint64_t ENCODED_CHECKPOINT_META_SIZE =
+	CHECKPOINT_META_SIZE + sizeof(PayloadEncoding) + sizeof(uint64_t);
+
+// Checkpoint metadata read from the journal, the payload is left on disk
+struct JournalEntry {
+	unsigned int m_id;
+	CCPoint m_objectPos;
+	double m_time;
+	double m_percent;
+	uint64_t m_payloadOffset;
+	uint64_t m_payloadSize;
+	PayloadEncoding m_payloadEncoding;
+	uint64_t m_payloadRawSize;
+	std::vector<uint64_t> m_blocks;
+};
+
+// Replays the checkpoint records of a journal. Checkpoints are placed once
+// every record is read, each one before the first checkpoint that was further
+// than it when it was added, which is where it went when it was marked
+class JournalReplay {
+public:
+	JournalReplay(bool platformer);
+
+	void add(JournalEntry entry);
+	void remove(unsigned int id);
+	// Checkpoints that aren't in the order are dropped
+	void order(const std::vector<unsigned int>& ids);
+	std::vector<JournalEntry> finish();
+
+private:
+	bool m_platformer;
+	// The ones before m_orderedCount are in the order of the last order record
+	// and the ones after it in the order they were added
+	std::vector<JournalEntry> m_entries;
+	size_t m_orderedCount = 0;
+	std::vector<bool> m_removed;
+	std::unordered_map<unsigned int, size_t> m_indices;
+
+	double getKey(const JournalEntry& entry) const;
+};
+
+// Returns the offset of the payload inside the buffer, the payload has to be
+// encoded the way the checkpoint says it is
+uint64_t appendCheckpointRecord(
+	std::vector<char>& buffer, PersistentCheckpoint* checkpoint,
+	const char* payload, uint64_t payloadSize
+);
+// For records copied from another layer, the payload size is taken from the
+// entry
+uint64_t appendCheckpointRecord(
+	std::vector<char>& buffer, const JournalEntry& entry, const char* payload
+);
+void appendDictionaryRecord(
+	std::vector<char>& buffer, const std::vector<char>& dictionary
+);
+void appendBaselineRecord(
+	std::vector<char>& buffer, const std::vector<char>& baseline
+);
+void appendRemoveRecord(std::vector<char>& buffer, unsigned int id);
+void appendOrderRecord(
+	std::vector<char>& buffer, const CheckpointStore& store
+);
+
+uint64_t getCheckpointRecordSize(PersistentCheckpoint* checkpoint);
+uint64_t getOrderRecordSize(unsigned int checkpointCount);
+uint32_t getRecordChecksum(const char* frame, const char* body);
+// Fills in the body size and checksum of the record at the offset once its
+// body is written, for any record type that has the journal's header
+void endRecord(std::vector<char>& buffer, uint64_t recordOffset);
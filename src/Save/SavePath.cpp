@@ -0,0 +1,277 @@
+#include "SavePath.hpp"
+#include "Hash.hpp"
+#include "SaveCatalog.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <atomic>
+#include <cctype>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace geode::prelude;
+
+// Files a level can have in the flat layout, besides the numbered layer files
+// from before containers
+const char* const FLAT_SAVE_EXTENSIONS[] = {
+	".pcpc", ".pcpb", ".pcpq", ".pcpm", ".pcpt"
+};
+
+static std::atomic<bool> s_shardMigrationDone = false;
+// Moves from the migration thread and from levels being played don't overlap
+static std::mutex s_shardMigrationMutex;
+
+std::filesystem::path getSavesDirectory() {
+	return Mod::get()->getSaveDir() / "saves";
+}
+
+std::filesystem::path getLevelArchivePath(const std::filesystem::path& basePath
+) {
+	std::filesystem::path archivePath =
+		getSavesDirectory() / "archive" /
+		basePath.lexically_relative(getSavesDirectory());
+	archivePath.concat(".pcpa");
+
+	return archivePath;
+}
+
+static std::string getCleanLevelName(GJGameLevel* level) {
+	std::string cleanLevelName = level->m_levelName;
+	cleanLevelName.erase(
+		std::remove(cleanLevelName.begin(), cleanLevelName.end(), '.'),
+		cleanLevelName.end()
+	);
+	cleanLevelName.erase(
+		std::remove(cleanLevelName.begin(), cleanLevelName.end(), '/'),
+		cleanLevelName.end()
+	);
+	cleanLevelName.erase(
+		std::remove(cleanLevelName.begin(), cleanLevelName.end(), '\\'),
+		cleanLevelName.end()
+	);
+
+	return cleanLevelName;
+}
+
+static std::string getMainShard(const std::string& levelID) {
+	if (levelID.size() < 2)
+		return "0" + levelID;
+
+	return levelID.substr(levelID.size() - 2);
+}
+
+static std::string getEditorShard(const std::string& cleanLevelName) {
+	return fmt::format(
+		"{:02x}", hashBytes(cleanLevelName.data(), cleanLevelName.size()) & 0xFF
+	);
+}
+
+std::filesystem::path
+getLevelSaveBasePath(GJGameLevel* level, bool lowDetailMode) {
+	std::filesystem::path flatBasePath =
+		getFlatLevelSaveBasePath(level, lowDetailMode);
+
+	std::string shard;
+	if (level->m_levelType == GJLevelType::Editor)
+		shard = getEditorShard(getCleanLevelName(level));
+	else
+		shard = getMainShard(std::to_string(level->m_levelID.value()));
+
+	return flatBasePath.parent_path() / shard / flatBasePath.filename();
+}
+
+std::filesystem::path
+getFlatLevelSaveBasePath(GJGameLevel* level, bool lowDetailMode) {
+	std::string savePath = string::pathToString(Mod::get()->getSaveDir());
+	switch (level->m_levelType) {
+	case GJLevelType::Editor:
+		savePath.append(
+			fmt::format(
+				"/saves/editor/{}-rev{}", getCleanLevelName(level),
+				level->m_levelRev
+			)
+		);
+		break;
+	default:
+		savePath.append(fmt::format("/saves/main/{}", level->m_levelID.value()));
+		break;
+	}
+
+	if (lowDetailMode)
+		savePath.append("-lowDetail");
+
+	return savePath;
+}
+
+// Online level files start with the ID. Editor level files are named
+// {name}-rev{revision}, where the name can have dashes too
+static std::optional<std::string>
+getFlatFileShard(const std::string& fileName, bool editor) {
+	auto digitsEnd = [&fileName](size_t position) {
+		while (position < fileName.size() &&
+				 std::isdigit((unsigned char)fileName[position]))
+			position++;
+		return position;
+	};
+
+	if (!editor) {
+		size_t idEnd = digitsEnd(0);
+		if (idEnd == 0)
+			return std::nullopt;
+
+		return getMainShard(fileName.substr(0, idEnd));
+	}
+
+	size_t position = fileName.rfind("-rev");
+	while (position != std::string::npos) {
+		size_t revisionEnd = digitsEnd(position + 4);
+		if (revisionEnd > position + 4 &&
+			 (revisionEnd == fileName.size() || fileName[revisionEnd] == '.' ||
+			  fileName[revisionEnd] == '_' || fileName[revisionEnd] == '-'))
+			return getEditorShard(fileName.substr(0, position));
+
+		if (position == 0)
+			break;
+		position = fileName.rfind("-rev", position - 1);
+	}
+
+	return std::nullopt;
+}
+
+// Files already in the shard are never replaced
+static bool moveSaveFile(
+	const std::filesystem::path& from, const std::filesystem::path& to
+) {
+	std::error_code error;
+	if (!std::filesystem::exists(from, error))
+		return false;
+
+	if (std::filesystem::exists(to, error)) {
+		log::warn(
+			"Not moving {} into its shard, it already has that file",
+			string::pathToString(from)
+		);
+		return false;
+	}
+
+	std::filesystem::create_directories(to.parent_path(), error);
+	std::filesystem::rename(from, to, error);
+	if (error) {
+		log::error(
+			"Failed to move {}: {}", string::pathToString(from), error.message()
+		);
+		return false;
+	}
+
+	return true;
+}
+
+bool isShardMigrationDone() { return s_shardMigrationDone; }
+
+bool moveFlatLevelSaves(
+	const std::filesystem::path& flatBasePath,
+	const std::filesystem::path& basePath
+) {
+	std::lock_guard lock(s_shardMigrationMutex);
+	bool moved = false;
+
+	for (const char* extension : FLAT_SAVE_EXTENSIONS) {
+		std::filesystem::path from = flatBasePath;
+		std::filesystem::path to = basePath;
+		from.concat(extension);
+		to.concat(extension);
+
+		moved |= moveSaveFile(from, to);
+	}
+
+	for (unsigned int layer = 0;; layer++) {
+		std::filesystem::path from = flatBasePath;
+		std::filesystem::path to = basePath;
+		from.concat(fmt::format("_{}.pcp", layer));
+		to.concat(fmt::format("_{}.pcp", layer));
+
+		if (!moveSaveFile(from, to))
+			break;
+		moved = true;
+	}
+
+	return moved;
+}
+
+// The catalog is only updated on the main thread, once every file is moved
+static void migrateFlatSaves(std::filesystem::path savesDirectory) {
+	std::vector<std::pair<std::filesystem::path, std::filesystem::path>>
+		movedLevels;
+	unsigned int movedFiles = 0;
+	bool complete = true;
+
+	for (bool editor : {false, true}) {
+		std::filesystem::path directory =
+			savesDirectory / (editor ? "editor" : "main");
+
+		std::error_code error;
+		if (!std::filesystem::exists(directory, error))
+			continue;
+
+		// The listing is taken first, the directory changes while moving
+		std::vector<std::filesystem::path> files;
+		for (const std::filesystem::directory_entry& file :
+			  std::filesystem::directory_iterator(directory, error))
+			if (file.is_regular_file(error))
+				files.push_back(file.path());
+
+		if (error) {
+			complete = false;
+			continue;
+		}
+
+		for (const std::filesystem::path& file : files) {
+			std::filesystem::path extension = file.extension();
+			if (extension != ".pcp" &&
+				 std::find(
+					 std::begin(FLAT_SAVE_EXTENSIONS),
+					 std::end(FLAT_SAVE_EXTENSIONS), extension
+				 ) == std::end(FLAT_SAVE_EXTENSIONS))
+				continue;
+
+			std::optional<std::string> shard =
+				getFlatFileShard(string::pathToString(file.filename()), editor);
+			if (!shard.has_value())
+				continue;
+
+			std::filesystem::path to = directory / shard.value() / file.filename();
+
+			std::lock_guard lock(s_shardMigrationMutex);
+			if (!moveSaveFile(file, to))
+				continue;
+
+			movedFiles++;
+			if (extension == ".pcpc" || extension == ".pcpb")
+				movedLevels.emplace_back(file, to);
+		}
+	}
+
+	Loader::get()->queueInMainThread([movedLevels = std::move(movedLevels),
+												 movedFiles, complete]() {
+		for (const auto& [from, to] : movedLevels)
+			SaveCatalog::get()->moveLevel(from, to);
+
+		if (complete) {
+			Mod::get()->setSavedValue("save-shards-migrated", true);
+			s_shardMigrationDone = true;
+		}
+
+		log::info("Moved {} save files into shards", movedFiles);
+	});
+}
+
+$execute {
+	s_shardMigrationDone =
+		Mod::get()->getSavedValue<bool>("save-shards-migrated");
+
+	if (!s_shardMigrationDone)
+		std::thread(migrateFlatSaves, getSavesDirectory()).detach();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <Geode/binding/GJGameLevel.hpp>
+
+#include <filesystem>
+
+std::filesystem::path getSavesDirectory();
+// Path of a level's save files without the extension. Saves are spread over
+// shard directories so none of them gets too big: online levels by the last
+// two digits of their ID, editor levels by a hash of their name
+std::filesystem::path
+getLevelSaveBasePath(GJGameLevel* level, bool lowDetailMode);
+// Where the level's saves were before shards
+std::filesystem::path
+getFlatLevelSaveBasePath(GJGameLevel* level, bool lowDetailMode);
+// Where the saves of a level go when they're archived
+std::filesystem::path getLevelArchivePath(const std::filesystem::path& basePath
+);
+
+// Saves in the flat layout are moved into their shards on a background thread
+// when the game starts, levels played before it's done move their own saves
+bool isShardMigrationDone();
+// Returns true if any file was moved
+bool moveFlatLevelSaves(
+	const std::filesystem::path& flatBasePath,
+	const std::filesystem::path& basePath
+);
@@ -0,0 +1,216 @@
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef GEODE_IS_WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace geode::prelude;
+
+Durability getDurability() {
+	std::string durability =
+		Mod::get()->getSettingValue<std::string>("save-durability");
+
+	if (durability == "Fast")
+		return Durability::Fast;
+	if (durability == "Paranoid")
+		return Durability::Paranoid;
+	return Durability::Safe;
+}
+
+SaveWriter* SaveWriter::get() {
+	static SaveWriter instance;
+	return &instance;
+}
+
+void SaveWriter::write(
+	const std::filesystem::path& path, std::vector<char> data
+) {
+	Durability durability = getDurability();
+	std::unique_lock lock(m_mutex);
+
+	// Writes for this file right before this one would be overwritten anyway,
+	// earlier ones stay so they don't end up after writes to other files
+	while (!m_queue.empty() && m_queue.back().m_path == path)
+		m_queue.pop_back();
+
+	enqueue(
+		{OperationType::Write, path, std::move(data), durability, nullptr},
+		std::move(lock)
+	);
+}
+
+void SaveWriter::append(
+	const std::filesystem::path& path, std::vector<char> data
+) {
+	Durability durability = getDurability();
+	std::unique_lock lock(m_mutex);
+
+	// Appending to the last queued operation for the same file gives the same
+	// result with a single write
+	if (!m_queue.empty() && m_queue.back().m_path == path) {
+		Operation& operation = m_queue.back();
+		operation.m_data.insert(operation.m_data.end(), data.begin(), data.end());
+		operation.m_durability = std::max(operation.m_durability, durability);
+		return;
+	}
+
+	enqueue(
+		{OperationType::Append, path, std::move(data), durability, nullptr},
+		std::move(lock)
+	);
+}
+
+void SaveWriter::queueTask(std::function<void()> task) {
+	Operation operation;
+	operation.m_type = OperationType::Task;
+	operation.m_task = std::move(task);
+
+	enqueue(std::move(operation), std::unique_lock(m_mutex));
+}
+
+void SaveWriter::flush() {
+	std::unique_lock lock(m_mutex);
+	m_flushCondition.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+SaveWriter::~SaveWriter() {
+	flush();
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_stopping = true;
+	}
+	m_queueCondition.notify_one();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void SaveWriter::enqueue(
+	Operation operation, std::unique_lock<std::mutex> lock
+) {
+	m_queue.push_back(std::move(operation));
+
+	if (!m_thread.joinable())
+		m_thread = std::thread(&SaveWriter::run, this);
+
+	lock.unlock();
+	m_queueCondition.notify_one();
+}
+
+void SaveWriter::run() {
+	std::unique_lock lock(m_mutex);
+
+	while (true) {
+		m_queueCondition.wait(lock, [this] {
+			return !m_queue.empty() || m_stopping;
+		});
+
+		if (m_queue.empty())
+			return;
+
+		Operation operation = std::move(m_queue.front());
+		m_queue.pop_front();
+		m_busy = true;
+
+		lock.unlock();
+		perform(operation);
+		lock.lock();
+
+		m_busy = false;
+		if (m_queue.empty())
+			m_flushCondition.notify_all();
+	}
+}
+
+// Files are written through the C library, so they can be synced
+static bool writeFile(
+	const std::filesystem::path& path, const std::vector<char>& data,
+	bool append, bool sync
+) {
+#ifdef GEODE_IS_WINDOWS
+	FILE* file = _wfopen(path.c_str(), append ? L"ab" : L"wb");
+#else
+	FILE* file = std::fopen(path.c_str(), append ? "ab" : "wb");
+#endif
+	if (file == nullptr)
+		return false;
+
+	bool written =
+		std::fwrite(data.data(), 1, data.size(), file) == data.size() &&
+		std::fflush(file) == 0;
+
+#ifdef GEODE_IS_WINDOWS
+	if (written && sync)
+		written = _commit(_fileno(file)) == 0;
+#else
+	if (written && sync)
+		written = fsync(fileno(file)) == 0;
+#endif
+
+	return std::fclose(file) == 0 && written;
+}
+
+// Makes a rename survive a crash, Windows can't sync directories and doesn't
+// need to
+static void syncDirectory(const std::filesystem::path& directory) {
+#ifndef GEODE_IS_WINDOWS
+	int descriptor = open(directory.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return;
+
+	fsync(descriptor);
+	close(descriptor);
+#endif
+}
+
+void SaveWriter::perform(const Operation& operation) {
+	if (operation.m_type == OperationType::Task) {
+		operation.m_task();
+		return;
+	}
+
+	bool append = operation.m_type == OperationType::Append;
+	bool replace = !append && operation.m_durability != Durability::Fast;
+	bool sync = operation.m_durability == Durability::Paranoid;
+
+	std::filesystem::path path = operation.m_path;
+	if (replace)
+		path.concat(".tmp");
+
+	bool written = writeFile(path, operation.m_data, append, sync);
+	// Shard directories are only created once something is saved in them
+	if (!written) {
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+		written = writeFile(path, operation.m_data, append, sync);
+	}
+
+	if (!written) {
+		log::error("Failed to write {}", string::pathToString(path));
+		return;
+	}
+
+	if (replace) {
+		std::error_code error;
+		std::filesystem::rename(path, operation.m_path, error);
+		if (error) {
+			log::error(
+				"Failed to replace {}: {}", string::pathToString(operation.m_path),
+				error.message()
+			);
+			return;
+		}
+
+		if (sync)
+			syncDirectory(operation.m_path.parent_path());
+	}
+}
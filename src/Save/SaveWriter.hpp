@@ -0,0 +1,66 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How much a write is protected from crashes. Safe writes whole files to a
+// temporary file that then replaces the old one, Paranoid also syncs every
+// write and the rename to disk
+enum class Durability {
+	Fast,
+	Safe,
+	Paranoid,
+};
+
+Durability getDurability();
+
+// Writes save files on a worker thread. Queued writes to the same file are
+// coalesced, so only the latest contents get written
+class SaveWriter {
+public:
+	static SaveWriter* get();
+
+	// Replaces the whole file, how depends on the durability setting
+	void write(const std::filesystem::path& path, std::vector<char> data);
+	void append(const std::filesystem::path& path, std::vector<char> data);
+	// Runs the task on the worker thread once the writes queued before it are
+	// done. Tasks can't flush, but they can queue writes
+	void queueTask(std::function<void()> task);
+	// Blocks until every queued write is on disk, must be called before
+	// reading or moving save files
+	void flush();
+
+	~SaveWriter();
+
+private:
+	enum class OperationType {
+		Write,
+		Append,
+		Task,
+	};
+
+	struct Operation {
+		OperationType m_type;
+		std::filesystem::path m_path;
+		std::vector<char> m_data;
+		Durability m_durability = Durability::Safe;
+		std::function<void()> m_task;
+	};
+
+	std::deque<Operation> m_queue;
+	std::mutex m_mutex;
+	std::condition_variable m_queueCondition;
+	std::condition_variable m_flushCondition;
+	bool m_busy = false;
+	bool m_stopping = false;
+	std::thread m_thread;
+
+	// Takes the lock on m_mutex that the caller checked the queue under
+	void enqueue(Operation operation, std::unique_lock<std::mutex> lock);
+	void run();
+	void perform(const Operation& operation);
+};
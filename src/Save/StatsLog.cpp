@@ -0,0 +1,317 @@
+#include "StatsLog.hpp"
+#include "ByteBuffer.hpp"
+#include "Checksum.hpp"
+#include "MappedFile.hpp"
+#include "SaveWriter.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+using namespace geode::prelude;
+
+const char STATS_HEADER[] = "PCP STATS";
+const unsigned int STATS_VERSION = 2;
+// Since version 2 every record ends with a checksum of its bytes
+const unsigned int CHECKSUMMED_STATS_VERSION = 2;
+const uint64_t STATS_HEADER_SIZE = sizeof(STATS_HEADER) + sizeof(unsigned int);
+
+enum class StatsRecord : char {
+	// Layer and checkpoint ID
+	Attempt = 1,
+	// Also has the percent the player died at
+	Death = 2,
+	Remove = 3,
+	// Every stat of a checkpoint, written by compactions
+	Summary = 4,
+	// Layer
+	RemoveLayer = 5,
+	// Both layers
+	SwapLayers = 6,
+};
+
+// The log is compacted on load once it has this many more records than
+// checkpoints
+const uint64_t MIN_STATS_SLACK = 4096;
+
+static uint64_t getStatsKey(unsigned int layer, unsigned int id) {
+	return (uint64_t)layer << 32 | id;
+}
+
+static unsigned int getKeyLayer(uint64_t key) { return key >> 32; }
+
+static unsigned int getKeyID(uint64_t key) { return key & 0xFFFFFFFF; }
+
+static void appendChecksum(std::vector<char>& records, uint64_t recordOffset) {
+	appendValue(
+		records,
+		crc32c(records.data() + recordOffset, records.size() - recordOffset)
+	);
+}
+
+void StatsLog::load(const std::filesystem::path& path, bool readOnly) {
+	clear();
+	m_path = path;
+	m_readOnly = readOnly;
+
+	SaveWriter::get()->flush();
+
+	MappedFile statsFile;
+	if (!statsFile.open(path))
+		return;
+
+	ByteReader reader = statsFile.reader();
+
+	// A header cut short by a crash is written again, logs from other versions
+	// are left alone
+	char header[sizeof(STATS_HEADER)];
+	unsigned int version;
+	if (!reader.read(header, sizeof(header)) || !reader.read(version)) {
+		statsFile.close();
+		compact();
+		return;
+	}
+	if (std::memcmp(header, STATS_HEADER, sizeof(header)) != 0 ||
+		 version > STATS_VERSION) {
+		log::error("Invalid stats log {}", string::pathToString(path));
+		m_readOnly = true;
+		return;
+	}
+
+	// A record cut short by a crash or damaged on disk ends the log
+	bool checksummed = version >= CHECKSUMMED_STATS_VERSION;
+	uint64_t position = reader.position();
+	while (reader.remaining() > 0) {
+		StatsRecord type;
+		unsigned int layer;
+		unsigned int id;
+		if (!reader.read(type) || !reader.read(layer) || !reader.read(id))
+			break;
+
+		// The whole record is read and checked before it's applied
+		float percent = 0;
+		CheckpointStats summary;
+		bool complete = true;
+		if (type == StatsRecord::Death)
+			complete = reader.read(percent);
+		else if (type == StatsRecord::Summary)
+			complete = reader.read(summary.m_attempts) &&
+						  reader.read(summary.m_deaths) &&
+						  reader.read(summary.m_bestPercent);
+		else if (type < StatsRecord::Attempt || type > StatsRecord::SwapLayers)
+			complete = false;
+
+		uint32_t checksum;
+		if (!complete ||
+			 (checksummed &&
+			  (!reader.read(checksum) ||
+				checksum != crc32c(
+								  reader.data() + position,
+								  reader.position() - sizeof(checksum) - position
+							  ))))
+			break;
+
+		uint64_t key = getStatsKey(layer, id);
+
+		if (type == StatsRecord::Attempt)
+			m_stats[key].m_attempts++;
+		else if (type == StatsRecord::Death) {
+			CheckpointStats& stats = m_stats[key];
+			stats.m_deaths++;
+			stats.m_bestPercent = std::max(stats.m_bestPercent, percent);
+		} else if (type == StatsRecord::Remove)
+			m_stats.erase(key);
+		else if (type == StatsRecord::Summary)
+			m_stats[key] = summary;
+		else if (type == StatsRecord::RemoveLayer)
+			moveLayers(layer, UINT_MAX);
+		else if (type == StatsRecord::SwapLayers)
+			moveLayers(layer, id);
+
+		m_recordCount++;
+		position = reader.position();
+	}
+
+	uint64_t fileSize = statsFile.size();
+	statsFile.close();
+
+	m_size = position;
+
+	// Logs from before checksums are rewritten with them
+	if (position < fileSize || version < STATS_VERSION ||
+		 m_recordCount > m_stats.size() + MIN_STATS_SLACK)
+		compact();
+}
+
+bool StatsLog::isLoaded() { return !m_path.empty(); }
+
+void StatsLog::clear() {
+	m_path.clear();
+	m_stats.clear();
+	m_size = 0;
+	m_recordCount = 0;
+	m_readOnly = false;
+}
+
+const CheckpointStats*
+StatsLog::getStats(unsigned int layer, unsigned int id) {
+	auto stats = m_stats.find(getStatsKey(layer, id));
+	if (stats == m_stats.end())
+		return nullptr;
+
+	return &stats->second;
+}
+
+void StatsLog::recordAttempt(unsigned int layer, unsigned int id) {
+	m_stats[getStatsKey(layer, id)].m_attempts++;
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::Attempt);
+	appendValue(record, layer);
+	appendValue(record, id);
+	append(std::move(record));
+}
+
+// Written as a summary record, the same one compactions write
+void StatsLog::setStats(
+	unsigned int layer, unsigned int id, const CheckpointStats& stats
+) {
+	m_stats[getStatsKey(layer, id)] = stats;
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::Summary);
+	appendValue(record, layer);
+	appendValue(record, id);
+	appendValue(record, stats.m_attempts);
+	appendValue(record, stats.m_deaths);
+	appendValue(record, stats.m_bestPercent);
+	append(std::move(record));
+}
+
+void StatsLog::copyStats(
+	unsigned int fromLayer, unsigned int fromID, unsigned int toLayer,
+	unsigned int toID
+) {
+	auto stats = m_stats.find(getStatsKey(fromLayer, fromID));
+	if (stats == m_stats.end())
+		return;
+
+	setStats(toLayer, toID, CheckpointStats(stats->second));
+}
+
+void StatsLog::recordDeath(
+	unsigned int layer, unsigned int id, float percent
+) {
+	CheckpointStats& stats = m_stats[getStatsKey(layer, id)];
+	stats.m_deaths++;
+	stats.m_bestPercent = std::max(stats.m_bestPercent, percent);
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::Death);
+	appendValue(record, layer);
+	appendValue(record, id);
+	appendValue(record, percent);
+	append(std::move(record));
+}
+
+void StatsLog::removeStats(unsigned int layer, unsigned int id) {
+	if (m_stats.erase(getStatsKey(layer, id)) == 0)
+		return;
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::Remove);
+	appendValue(record, layer);
+	appendValue(record, id);
+	append(std::move(record));
+}
+
+// Every record starts with two ints, layer records that only need one still
+// write the second
+void StatsLog::removeLayer(unsigned int layer) {
+	moveLayers(layer, UINT_MAX);
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::RemoveLayer);
+	appendValue(record, layer);
+	appendValue(record, (unsigned int)0);
+	append(std::move(record));
+}
+
+void StatsLog::swapLayers(unsigned int left, unsigned int right) {
+	moveLayers(left, right);
+
+	std::vector<char> record;
+	appendValue(record, StatsRecord::SwapLayers);
+	appendValue(record, left);
+	appendValue(record, right);
+	append(std::move(record));
+}
+
+// Swaps the stats of two layers, a right layer of UINT_MAX removes the left
+// one and moves the layers after it back one place
+void StatsLog::moveLayers(unsigned int left, unsigned int right) {
+	std::unordered_map<uint64_t, CheckpointStats> stats;
+	for (const auto& [key, checkpointStats] : m_stats) {
+		unsigned int layer = getKeyLayer(key);
+		if (right == UINT_MAX) {
+			if (layer == left)
+				continue;
+			if (layer > left)
+				layer--;
+		} else if (layer == left)
+			layer = right;
+		else if (layer == right)
+			layer = left;
+
+		stats[getStatsKey(layer, getKeyID(key))] = checkpointStats;
+	}
+
+	m_stats = std::move(stats);
+}
+
+void StatsLog::append(std::vector<char> record) {
+	if (!isLoaded() || m_readOnly)
+		return;
+
+	appendChecksum(record, 0);
+
+	if (m_size == 0) {
+		record.insert(record.begin(), STATS_HEADER_SIZE, 0);
+		std::memcpy(record.data(), STATS_HEADER, sizeof(STATS_HEADER));
+		std::memcpy(
+			record.data() + sizeof(STATS_HEADER), &STATS_VERSION,
+			sizeof(STATS_VERSION)
+		);
+	}
+
+	m_size += record.size();
+	m_recordCount++;
+	SaveWriter::get()->append(m_path, std::move(record));
+}
+
+void StatsLog::compact() {
+	if (m_readOnly)
+		return;
+
+	std::vector<char> records(
+		STATS_HEADER, STATS_HEADER + sizeof(STATS_HEADER)
+	);
+	appendValue(records, STATS_VERSION);
+
+	for (const auto& [key, stats] : m_stats) {
+		uint64_t recordOffset = records.size();
+		appendValue(records, StatsRecord::Summary);
+		appendValue(records, getKeyLayer(key));
+		appendValue(records, getKeyID(key));
+		appendValue(records, stats.m_attempts);
+		appendValue(records, stats.m_deaths);
+		appendValue(records, stats.m_bestPercent);
+		appendChecksum(records, recordOffset);
+	}
+
+	m_size = records.size();
+	m_recordCount = m_stats.size();
+	SaveWriter::get()->write(m_path, std::move(records));
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+struct CheckpointStats {
+	// Times the level was started from the checkpoint
+	unsigned int m_attempts = 0;
+	unsigned int m_deaths = 0;
+	float m_bestPercent = 0;
+};
+
+// Practice stats of the checkpoints of a level, kept apart from the saves so
+// recording a death appends a few bytes instead of rewriting a layer. The
+// file is a log of events keyed by layer and checkpoint ID, layer swaps and
+// removals are logged too so the keys stay right. Every record has a
+// checksum. It's compacted into one record per checkpoint when it's loaded
+// with too many records
+class StatsLog {
+public:
+	// A read only log is never written to, for reading the stats of a backup
+	void load(const std::filesystem::path& path, bool readOnly = false);
+	bool isLoaded();
+	// Forgets every stat, for when the file was replaced
+	void clear();
+
+	// Returns nullptr if nothing was recorded for the checkpoint
+	const CheckpointStats* getStats(unsigned int layer, unsigned int id);
+	void recordAttempt(unsigned int layer, unsigned int id);
+	void setStats(
+		unsigned int layer, unsigned int id, const CheckpointStats& stats
+	);
+	// For checkpoints copied to another layer, their ID changes there
+	void copyStats(
+		unsigned int fromLayer, unsigned int fromID, unsigned int toLayer,
+		unsigned int toID
+	);
+	void recordDeath(unsigned int layer, unsigned int id, float percent);
+	void removeStats(unsigned int layer, unsigned int id);
+	// Layers after the removed one move back one place
+	void removeLayer(unsigned int layer);
+	void swapLayers(unsigned int left, unsigned int right);
+
+private:
+	std::filesystem::path m_path;
+	std::unordered_map<uint64_t, CheckpointStats> m_stats;
+	uint64_t m_size = 0;
+	uint64_t m_recordCount = 0;
+	// Logs from other versions are never written to
+	bool m_readOnly = false;
+
+	void moveLayers(unsigned int left, unsigned int right);
+	void append(std::vector<char> record);
+	void compact();
+};
@@ -0,0 +1,207 @@
+#include "BackupPopup.hpp"
+#include "../Hooks/PlayLayer.hpp"
+
+#include <Geode/binding/FLAlertLayer.hpp>
+#include <Geode/binding/PlayLayer.hpp>
+
+#include <ctime>
+
+BackupPopup* BackupPopup::create(std::function<void()> onRestore) {
+	auto ret = new BackupPopup();
+	if (ret->initAnchored(260.f, 240.f, onRestore, "GJ_square02.png")) {
+		ret->autorelease();
+		return ret;
+	}
+
+	delete ret;
+	return nullptr;
+}
+
+bool BackupPopup::setup(std::function<void()> onRestore) {
+	m_onRestore = onRestore;
+
+	m_noElasticity = true;
+
+	setTitle("Backups");
+
+	CCLayerColor* listContainer = CCLayerColor::create();
+	listContainer->setContentSize(ccp(230, 150));
+	listContainer->setAnchorPoint(ccp(.5, 1));
+	listContainer->setColor(ccc3(74, 97, 225));
+	listContainer->setOpacity(255);
+	listContainer->setZOrder(5);
+	m_listContainer = listContainer;
+
+	m_emptyListLabel = CCLabelBMFont::create(
+		"No backups of this level yet.", "bigFont.fnt", 215
+	);
+	m_emptyListLabel->setScale(.7);
+	m_emptyListLabel->setOpacity(150);
+	m_emptyListLabel->setAlignment(CCTextAlignment::kCCTextAlignmentCenter);
+	m_emptyListLabel->setZOrder(20);
+
+	CCMenuItemSpriteExtra* backUpButton = CCMenuItemExt::createSpriteExtra(
+		ButtonSprite::create("Back Up Now"),
+		[this](CCMenuItemSpriteExtra* sender) {
+			SaveBackup::get()->snapshot();
+			createList();
+		}
+	);
+	backUpButton->m_baseScale = .7;
+	backUpButton->setScale(.7);
+
+	m_mainLayer->addChildAtPosition(
+		m_listContainer, geode::Anchor::Top, ccp(0, -35)
+	);
+	m_buttonMenu->addChildAtPosition(
+		backUpButton, geode::Anchor::Bottom, ccp(0, 25)
+	);
+
+	createList();
+
+	ListBorders* borders = ListBorders::create();
+	borders->setContentSize(m_listContainer->getContentSize() + ccp(7, 7));
+	borders->setZOrder(15);
+	borders->setSpriteFrames(
+		"GJ_commentTop2_001.png", "GJ_commentSide2_001.png"
+	);
+
+	m_listContainer->addChildAtPosition(borders, geode::Anchor::Center);
+	m_listContainer->addChildAtPosition(m_emptyListLabel, geode::Anchor::Center);
+
+	return true;
+}
+
+// Backups where the level's files are the same as in the next older one
+// aren't listed
+void BackupPopup::createList() {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer == nullptr)
+		return;
+
+	std::filesystem::path containerPath = playLayer->getContainerPath();
+	std::filesystem::path blockStorePath = playLayer->getBlockStorePath();
+
+	auto getFileHash = [](const BackupSnapshot& snapshot,
+								 const std::filesystem::path& path) {
+		const BackupFile* file = snapshot.getFile(path);
+		return file != nullptr ? file->m_hash : 0;
+	};
+
+	m_snapshots =
+		SaveBackup::get()->getLevelSnapshots(playLayer->getSaveBasePath());
+	for (unsigned int i = 0; i + 1 < m_snapshots.size();) {
+		if (getFileHash(m_snapshots[i], containerPath) ==
+				 getFileHash(m_snapshots[i + 1], containerPath) &&
+			 getFileHash(m_snapshots[i], blockStorePath) ==
+				 getFileHash(m_snapshots[i + 1], blockStorePath))
+			m_snapshots.erase(m_snapshots.begin() + i + 1);
+		else
+			i++;
+	}
+
+	if (m_listView != nullptr)
+		m_listView->removeFromParent();
+
+	CCArray* cells = CCArray::create();
+	for (unsigned int i = 0; i < m_snapshots.size(); i++)
+		cells->addObject(createSnapshotCell(i));
+
+	m_listView = ListView::create(
+		cells, 40, m_listContainer->getContentWidth(),
+		m_listContainer->getContentHeight()
+	);
+	m_listView->setPrimaryCellColor(ccc3(76, 105, 250));
+	m_listView->setSecondaryCellColor(ccc3(68, 91, 210));
+	m_listView->setZOrder(10);
+
+	m_listContainer->addChildAtPosition(m_listView, geode::Anchor::BottomLeft);
+	m_emptyListLabel->setVisible(m_snapshots.empty());
+}
+
+CCNode* BackupPopup::createSnapshotCell(unsigned int index) {
+	CCMenu* menu = CCMenu::create();
+	menu->setContentSize(ccp(230, 40));
+
+	std::time_t time = m_snapshots[index].m_time;
+	char timeString[32] = "";
+	if (std::tm* localTime = std::localtime(&time))
+		std::strftime(
+			timeString, sizeof(timeString), "%Y-%m-%d %H:%M", localTime
+		);
+
+	CCLabelBMFont* label = CCLabelBMFont::create(timeString, "goldFont.fnt");
+	label->setAnchorPoint(ccp(0, .5));
+	label->setScale(.55);
+
+	CCMenuItemSpriteExtra* levelButton = CCMenuItemExt::createSpriteExtra(
+		ButtonSprite::create("Level"),
+		[this, index](CCMenuItemSpriteExtra* sender) { restoreLevel(index); }
+	);
+	CCMenuItemSpriteExtra* layerButton = CCMenuItemExt::createSpriteExtra(
+		ButtonSprite::create("Layer"),
+		[this, index](CCMenuItemSpriteExtra* sender) { restoreLayer(index); }
+	);
+	levelButton->m_baseScale = .5;
+	layerButton->m_baseScale = .5;
+	levelButton->setScale(.5);
+	layerButton->setScale(.5);
+
+	menu->addChildAtPosition(label, geode::Anchor::Left, ccp(10, 0));
+	menu->addChildAtPosition(layerButton, geode::Anchor::Right, ccp(-80, 0));
+	menu->addChildAtPosition(levelButton, geode::Anchor::Right, ccp(-30, 0));
+
+	return menu;
+}
+
+void BackupPopup::restoreLevel(unsigned int index) {
+	geode::createQuickPopup(
+		"Restore Level",
+		"Replace every layer of this level with the ones in this backup?\n"
+		"The current saves are backed up first.",
+		"Cancel", "Restore", [this, index](auto, bool confirmed) {
+			ModPlayLayer* playLayer =
+				static_cast<ModPlayLayer*>(PlayLayer::get());
+			if (!confirmed || playLayer == nullptr)
+				return;
+
+			if (!playLayer->restoreBackupLevel(m_snapshots[index])) {
+				FLAlertLayer::create(
+					"Can't restore", "The backup of this level is damaged.", "Ok"
+				)
+					->show();
+				return;
+			}
+
+			if (m_onRestore)
+				m_onRestore();
+
+			onClose(nullptr);
+		}
+	);
+}
+
+// The current layer is restored as a new layer, nothing is overwritten
+void BackupPopup::restoreLayer(unsigned int index) {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer == nullptr)
+		return;
+
+	if (!playLayer->restoreBackupLayer(
+			 m_snapshots[index], playLayer->m_fields->m_activeSaveLayer
+		 )) {
+		FLAlertLayer::create(
+			"Can't restore",
+			"The backup doesn't have this layer, or parts of its checkpoints "
+			"are no longer saved. Restore the whole level instead.",
+			"Ok"
+		)
+			->show();
+		return;
+	}
+
+	if (m_onRestore)
+		m_onRestore();
+
+	onClose(nullptr);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "../Save/SaveBackup.hpp"
+
+#include <Geode/Geode.hpp>
+
+#include <functional>
+
+using namespace geode::prelude;
+
+// Lists the backups of the current level, any of them can be restored as a
+// whole or just the current layer
+class BackupPopup : public Popup<std::function<void()>> {
+public:
+	bool setup(std::function<void()> onRestore) override;
+	static BackupPopup* create(std::function<void()> onRestore);
+
+private:
+	std::function<void()> m_onRestore;
+	std::vector<BackupSnapshot> m_snapshots;
+	CCNode* m_listContainer = nullptr;
+	ListView* m_listView = nullptr;
+	CCLabelBMFont* m_emptyListLabel = nullptr;
+
+	void createList();
+	CCNode* createSnapshotCell(unsigned int index);
+	void restoreLevel(unsigned int index);
+	void restoreLayer(unsigned int index);
+};
@@ -1,5 +1,8 @@
 #include "CheckpointManager.hpp"
 #include "../Hooks/PlayLayer.hpp"
+#include "../Save/SaveCatalog.hpp"
+#include "BackupPopup.hpp"
+#include "CheckpointTransferPopup.hpp"
 #include "Geode/ui/Layout.hpp"
 
 #include <Geode/binding/CCMenuItemSpriteExtra.hpp>
@@ -7,6 +10,10 @@
 #include <Geode/binding/PlayLayer.hpp>
 #include <Geode/ui/GeodeUI.hpp>
 
+// Changes made in the manager are saved together once it's been left alone
+// for this long, or when it's closed
+const float SAVE_DELAY = 2.f;
+
 CheckpointManager* CheckpointManager::create() {
 	auto ret = new CheckpointManager();
 	if (ret->initAnchored(260.f, 280.f, "GJ_square02.png")) {
@@ -21,12 +28,14 @@ CheckpointManager* CheckpointManager::create() {
 bool CheckpointManager::setup() {
 	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
 	bool hasCheckpoints =
-		playLayer->m_fields->m_persistentCheckpointArray->count() > 0;
+		playLayer->m_fields->m_persistentCheckpoints.count() > 0;
 
 	m_noElasticity = true;
 
 	setTitle("Persistent Checkpoints");
 
+	playLayer->beginSaveBatch();
+
 	CCSprite* optionsSpr =
 		CCSprite::createWithSpriteFrameName("GJ_optionsBtn_001.png");
 	CCMenuItemSpriteExtra* optionsButton =
@@ -36,11 +45,39 @@ bool CheckpointManager::setup() {
 	optionsButton->m_baseScale = .6;
 	optionsButton->setScale(.6);
 
+	// Pinned levels are exempt from the storage limit
+	CCSprite* pinnedSpr = CCSprite::createWithSpriteFrameName("GJ_lock_001.png");
+	CCSprite* unpinnedSpr =
+		CCSprite::createWithSpriteFrameName("GJ_lock_open_001.png");
+	pinnedSpr->setScale(.7);
+	unpinnedSpr->setScale(.7);
+	CCMenuItemToggler* pinToggler = CCMenuItemExt::createToggler(
+		pinnedSpr, unpinnedSpr, [playLayer](CCMenuItemToggler* toggler) {
+			SaveCatalog::get()->setPinned(
+				playLayer->getContainerPath(), !toggler->isToggled()
+			);
+		}
+	);
+	pinToggler->toggle(
+		SaveCatalog::get()->isPinned(playLayer->getContainerPath())
+	);
+
+	// Backups of the level can be restored from here
+	CCSprite* backupSpr =
+		CCSprite::createWithSpriteFrameName("GJ_timeIcon_001.png");
+	CCMenuItemSpriteExtra* backupButton = CCMenuItemExt::createSpriteExtra(
+		backupSpr, [this](CCMenuItemSpriteExtra* sender) {
+			BackupPopup::create([this]() { updateUIElements(true); })->show();
+		}
+	);
+	backupButton->m_baseScale = .9;
+	backupButton->setScale(.9);
+
 	CCSprite* deleteSprite =
 		CCSprite::createWithSpriteFrameName("GJ_deleteBtn_001.png");
 	m_deleteButton = CCMenuItemExt::createSpriteExtra(
 		deleteSprite, [this, playLayer](CCMenuItemSpriteExtra* deleteButton) {
-			if (playLayer->m_fields->m_persistentCheckpointArray->count() > 0 ||
+			if (playLayer->m_fields->m_persistentCheckpoints.count() > 0 ||
 				 playLayer->m_fields->m_loadError != LoadError::None)
 				geode::createQuickPopup(
 					"Delete All",
@@ -71,6 +108,11 @@ bool CheckpointManager::setup() {
 	m_saveLayerLabel = CCLabelBMFont::create("", "bigFont.fnt");
 	m_saveLayerLabel->setScale(.6);
 
+	m_sizeLabel = CCLabelBMFont::create("", "chatFont.fnt");
+	m_sizeLabel->setAlignment(CCTextAlignment::kCCTextAlignmentCenter);
+	m_sizeLabel->setScale(.45);
+	m_sizeLabel->setOpacity(200);
+
 	CCSprite* previousLayerSpr =
 		CCSprite::createWithSpriteFrameName("GJ_arrow_01_001.png");
 	CCSprite* nextLayerSpr =
@@ -140,6 +182,12 @@ bool CheckpointManager::setup() {
 	m_buttonMenu->addChildAtPosition(
 		optionsButton, geode::Anchor::BottomLeft, ccp(3, 3)
 	);
+	m_buttonMenu->addChildAtPosition(
+		pinToggler, geode::Anchor::BottomLeft, ccp(33, 3)
+	);
+	m_buttonMenu->addChildAtPosition(
+		backupButton, geode::Anchor::BottomLeft, ccp(60, 3)
+	);
 	m_buttonMenu->addChildAtPosition(
 		m_deleteButton, geode::Anchor::BottomRight, ccp(-3, 3)
 	);
@@ -161,6 +209,9 @@ bool CheckpointManager::setup() {
 	m_mainLayer->addChildAtPosition(
 		m_listContainer, geode::Anchor::Top, ccp(0, -65)
 	);
+	m_mainLayer->addChildAtPosition(
+		m_sizeLabel, geode::Anchor::Bottom, ccp(0, 13)
+	);
 
 	m_emptyListLabel = CCLabelBMFont::create("", "bigFont.fnt", 215);
 	m_emptyListLabel->setScale(.7);
@@ -214,6 +265,28 @@ bool CheckpointManager::setup() {
 	return true;
 }
 
+void CheckpointManager::onClose(CCObject* sender) {
+	unschedule(schedule_selector(CheckpointManager::onSaveTimer));
+
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer != nullptr)
+		playLayer->commitSaveBatch();
+
+	Popup::onClose(sender);
+}
+
+void CheckpointManager::restartSaveTimer() {
+	unschedule(schedule_selector(CheckpointManager::onSaveTimer));
+	scheduleOnce(schedule_selector(CheckpointManager::onSaveTimer), SAVE_DELAY);
+}
+
+void CheckpointManager::onSaveTimer(float) {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer != nullptr)
+		playLayer->writeSaveBatch();
+}
+
+// Every change to the checkpoints recreates the list
 void CheckpointManager::createList(bool resetPosition) {
 	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
 	if (playLayer == nullptr)
@@ -233,12 +306,13 @@ void CheckpointManager::createList(bool resetPosition) {
 		if (carryPosition)
 			contentPosition =
 				m_listView->getChildByIndex(0)->getChildByIndex(0)->getPositionY();
+
+		restartSaveTimer();
 	}
 
-	CCArray* checkpointArray = playLayer->m_fields->m_persistentCheckpointArray;
-	for (PersistentCheckpoint* checkpoint :
-		  CCArrayExt<PersistentCheckpoint*>(checkpointArray)) {
-		unsigned int index = checkpointArray->indexOfObject(checkpoint);
+	CheckpointStore& store = playLayer->m_fields->m_persistentCheckpoints;
+	for (unsigned int index = 0; index < store.count(); index++) {
+		PersistentCheckpoint* checkpoint = store.at(index);
 
 		std::function<void(CCMenuItemSpriteExtra*)> moveUpCallback = nullptr;
 		std::function<void(CCMenuItemSpriteExtra*)> moveDownCallback = nullptr;
@@ -249,7 +323,7 @@ void CheckpointManager::createList(bool resetPosition) {
 				playLayer->swapPersistentCheckpoints(index, index - 1);
 				createList();
 			};
-		if (index != checkpointArray->count() - 1)
+		if (index != store.count() - 1)
 			moveDownCallback = [this, index,
 									  playLayer](CCMenuItemSpriteExtra* sender) {
 				playLayer->swapPersistentCheckpoints(index, index + 1);
@@ -260,8 +334,7 @@ void CheckpointManager::createList(bool resetPosition) {
 			checkpoint, moveUpCallback, moveDownCallback,
 			[this, checkpoint, playLayer](CCMenuItemSpriteExtra* sender) {
 				unsigned int index =
-					playLayer->m_fields->m_persistentCheckpointArray->indexOfObject(
-						checkpoint
+					playLayer->m_fields->m_persistentCheckpoints.indexOf(checkpoint
 					) +
 					1;
 
@@ -271,9 +344,14 @@ void CheckpointManager::createList(bool resetPosition) {
 				playLayer->switchCurrentCheckpoint(index);
 				createList();
 			},
+			[this, checkpoint](CCMenuItemSpriteExtra* sender) {
+				CheckpointTransferPopup::create(checkpoint, [this]() {
+					updateUIElements();
+				})->show();
+			},
 			[this, checkpoint, playLayer](CCMenuItemSpriteExtra* sender) {
 				bool updateLabel =
-					playLayer->m_fields->m_persistentCheckpointArray->count() == 1;
+					playLayer->m_fields->m_persistentCheckpoints.count() == 1;
 				playLayer->removePersistentCheckpoint(checkpoint);
 
 				if (updateLabel)
@@ -293,7 +371,7 @@ void CheckpointManager::createList(bool resetPosition) {
 	m_listView->setZOrder(10);
 
 	CCNode* listContent = m_listView->getChildByIndex(0)->getChildByIndex(0);
-	if (carryPosition && checkpointArray->count() >= 5) {
+	if (carryPosition && store.count() >= 5) {
 		listContent->setPositionY(contentPosition);
 		if (listContent->getPositionY() > 0)
 			listContent->setPositionY(0);
@@ -318,7 +396,7 @@ void CheckpointManager::updateUIElements(bool resetListPosition) {
 
 	createList(resetListPosition);
 
-	if (playLayer->m_fields->m_persistentCheckpointArray->count() == 0) {
+	if (playLayer->m_fields->m_persistentCheckpoints.count() == 0) {
 		const char* text;
 		switch (playLayer->m_fields->m_loadError) {
 		case None:
@@ -368,6 +446,23 @@ void CheckpointManager::updateUIElements(bool resetListPosition) {
 
 	m_forceLoadButton->setVisible(playLayer->m_fields->m_loadError != LoadError::None);
 
+	// Makes room for the force load button
+	SaveLayerSize layerSize = playLayer->getSaveLayerSize();
+	const CatalogEntry* levelEntry =
+		SaveCatalog::get()->getEntry(playLayer->getContainerPath());
+	m_sizeLabel->setString(
+		fmt::format(
+			"Layer: {} saved, {} in memory\nLevel: {} saved",
+			formatByteSize(layerSize.m_storedSize),
+			formatByteSize(layerSize.m_memorySize),
+			formatByteSize(levelEntry != nullptr ? levelEntry->getSize() : 0)
+		)
+			.c_str()
+	);
+	m_sizeLabel->setVisible(
+		playLayer->m_fields->m_loadError == LoadError::None
+	);
+
 	float layerSwitchOffset =
 		m_saveLayerLabel->getScaledContentWidth() / 2.f + 15.f;
 	if (AnchorLayoutOptions* options = typeinfo_cast<AnchorLayoutOptions*>(
@@ -416,14 +511,45 @@ void CheckpointManager::updateUIElements(bool resetListPosition) {
 	m_buttonMenu->updateLayout(false);
 }
 
+// The sizes are measured on the encoded checkpoint, decoding it if needed
+static void
+showCheckpointSize(ModPlayLayer* playLayer, PersistentCheckpoint* checkpoint) {
+	auto [encodedSize, memorySize] = playLayer->measureCheckpoint(checkpoint);
+	if (encodedSize.getTotal() == 0) {
+		FLAlertLayer::create(
+			"Can't measure", "The checkpoint couldn't be decoded.", "Ok"
+		)
+			->show();
+		return;
+	}
+
+	std::string text;
+	for (unsigned int i = 0; i < CHECKPOINT_SECTION_COUNT; i++)
+		text += fmt::format(
+			"{}: {} encoded, {} in memory\n",
+			getCheckpointSectionName((CheckpointSection)i),
+			formatByteSize(encodedSize.m_sections[i]),
+			formatByteSize(memorySize.m_sections[i])
+		);
+	text += fmt::format(
+		"Total: {} encoded, {} saved, {} in memory",
+		formatByteSize(encodedSize.getTotal()),
+		formatByteSize(playLayer->getCheckpointStoredSize(checkpoint)),
+		formatByteSize(memorySize.getTotal())
+	);
+
+	FLAlertLayer::create("Checkpoint Size", text, "Ok")->show();
+}
+
 CCNode* createCheckpointCell(
 	PersistentCheckpoint* checkpoint,
 	std::function<void(CCMenuItemSpriteExtra*)> moveUpCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> moveDownCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> selectCallback,
+	std::function<void(CCMenuItemSpriteExtra*)> transferCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> removeCallback
 ) {
-	PlayLayer* playLayer = PlayLayer::get();
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
 
 	CCMenu* menu = CCMenu::create();
 	menu->setContentSize(ccp(230, 40));
@@ -492,6 +618,32 @@ CCNode* createCheckpointCell(
 	label->setAnchorPoint(ccp(0, .5));
 	label->setScale(.65);
 
+	std::string detailString;
+	if (const CheckpointStats* stats =
+			 playLayer->getCheckpointStats(checkpoint)) {
+		detailString = fmt::format(
+			"{} att, {} deaths", stats->m_attempts, stats->m_deaths
+		);
+		if (!playLayer->m_level->isPlatformer() && stats->m_deaths > 0)
+			detailString += fmt::format(", best {:.0f}%", stats->m_bestPercent);
+		detailString += " | ";
+	}
+
+	uint64_t storedSize = playLayer->getCheckpointStoredSize(checkpoint);
+	detailString += storedSize != 0 ? formatByteSize(storedSize) : "Not saved";
+
+	// Pressing the details shows the size of each section
+	CCLabelBMFont* detailLabel =
+		CCLabelBMFont::create(detailString.c_str(), "chatFont.fnt");
+	detailLabel->setScale(.45);
+	detailLabel->setOpacity(200);
+	CCMenuItemSpriteExtra* detailBtn = CCMenuItemExt::createSpriteExtra(
+		detailLabel, [playLayer, checkpoint](CCMenuItemSpriteExtra* sender) {
+			showCheckpointSize(playLayer, checkpoint);
+		}
+	);
+	detailBtn->setAnchorPoint(ccp(0, .5));
+
 	CCSprite* removeSprite =
 		CCSprite::createWithSpriteFrameName("GJ_trashBtn_001.png");
 	CCMenuItemSpriteExtra* removeBtn =
@@ -499,10 +651,19 @@ CCNode* createCheckpointCell(
 	removeBtn->m_baseScale = .75;
 	removeBtn->setScale(.75);
 
+	CCSprite* transferSprite =
+		CCSprite::createWithSpriteFrameName("GJ_duplicateBtn_001.png");
+	CCMenuItemSpriteExtra* transferBtn =
+		CCMenuItemExt::createSpriteExtra(transferSprite, transferCallback);
+	transferBtn->m_baseScale = .45;
+	transferBtn->setScale(.45);
+
 	menu->addChildAtPosition(moveUpBtn, geode::Anchor::Left, ccp(15, 10));
 	menu->addChildAtPosition(moveDownBtn, geode::Anchor::Left, ccp(15, -10));
 	menu->addChildAtPosition(selectBtn, geode::Anchor::Left, ccp(35, 0));
-	menu->addChildAtPosition(label, geode::Anchor::Left, ccp(50, 0));
+	menu->addChildAtPosition(label, geode::Anchor::Left, ccp(50, 5));
+	menu->addChildAtPosition(detailBtn, geode::Anchor::Left, ccp(50, -10));
+	menu->addChildAtPosition(transferBtn, geode::Anchor::Right, ccp(-50, 0));
 	menu->addChildAtPosition(removeBtn, geode::Anchor::Right, ccp(-20, 0));
 
 	return menu;
@@ -6,12 +6,15 @@ using namespace geode::prelude;
 class CheckpointManager : public Popup<> {
 public:
 	bool setup() override;
+	void onClose(CCObject* sender) override;
 	static CheckpointManager* create();
 
 private:
 	CCMenuItemSpriteExtra* m_deleteButton = nullptr;
 	CCMenuItemSpriteExtra* m_forceLoadButton = nullptr;
 	CCLabelBMFont* m_saveLayerLabel = nullptr;
+	// Sizes of the layer and the level
+	CCLabelBMFont* m_sizeLabel = nullptr;
 	CCMenuItemSpriteExtra* m_previousLayerBtn = nullptr;
 	CCMenuItemSpriteExtra* m_nextLayerBtn = nullptr;
 	CCMenuItemSpriteExtra* m_moveLayerBackBtn = nullptr;
@@ -24,6 +27,8 @@ private:
 
 	void createList(bool resetPosition = false);
 	void updateUIElements(bool resetListPosition = false);
+	void restartSaveTimer();
+	void onSaveTimer(float);
 };
 
 CCNode* createCheckpointCell(
@@ -31,5 +36,6 @@ CCNode* createCheckpointCell(
 	std::function<void(CCMenuItemSpriteExtra*)> moveUpCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> moveDownCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> selectCallback,
+	std::function<void(CCMenuItemSpriteExtra*)> transferCallback,
 	std::function<void(CCMenuItemSpriteExtra*)> removeCallback
 );
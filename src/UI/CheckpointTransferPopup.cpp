@@ -0,0 +1,149 @@
+#include "CheckpointTransferPopup.hpp"
+#include "../Hooks/PlayLayer.hpp"
+
+#include <Geode/binding/FLAlertLayer.hpp>
+#include <Geode/binding/PlayLayer.hpp>
+
+CheckpointTransferPopup* CheckpointTransferPopup::create(
+	PersistentCheckpoint* checkpoint, std::function<void()> onTransfer
+) {
+	auto ret = new CheckpointTransferPopup();
+	if (ret->initAnchored(
+			 220.f, 130.f, checkpoint, onTransfer, "GJ_square02.png"
+		 )) {
+		ret->autorelease();
+		return ret;
+	}
+
+	delete ret;
+	return nullptr;
+}
+
+bool CheckpointTransferPopup::setup(
+	PersistentCheckpoint* checkpoint, std::function<void()> onTransfer
+) {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	m_checkpoint = checkpoint;
+	m_onTransfer = onTransfer;
+
+	m_noElasticity = true;
+
+	setTitle("Copy to Layer");
+
+	m_targetLayer = playLayer->m_fields->m_activeSaveLayer;
+	m_layerLabel = CCLabelBMFont::create("", "bigFont.fnt");
+	m_layerLabel->setScale(.6);
+	switchTargetLayer(true);
+
+	CCSprite* previousLayerSpr =
+		CCSprite::createWithSpriteFrameName("GJ_arrow_01_001.png");
+	CCSprite* nextLayerSpr =
+		CCSprite::createWithSpriteFrameName("GJ_arrow_01_001.png");
+	nextLayerSpr->setFlipX(true);
+
+	CCMenuItemSpriteExtra* previousLayerBtn = CCMenuItemExt::createSpriteExtra(
+		previousLayerSpr,
+		[this](CCMenuItemSpriteExtra* sender) { switchTargetLayer(false); }
+	);
+	CCMenuItemSpriteExtra* nextLayerBtn = CCMenuItemExt::createSpriteExtra(
+		nextLayerSpr,
+		[this](CCMenuItemSpriteExtra* sender) { switchTargetLayer(true); }
+	);
+	previousLayerBtn->m_baseScale = .6;
+	nextLayerBtn->m_baseScale = .6;
+	previousLayerBtn->setScale(.6);
+	nextLayerBtn->setScale(.6);
+
+	CCMenuItemSpriteExtra* copyButton = CCMenuItemExt::createSpriteExtra(
+		ButtonSprite::create("Copy"),
+		[this](CCMenuItemSpriteExtra* sender) { transfer(false); }
+	);
+	CCMenuItemSpriteExtra* moveButton = CCMenuItemExt::createSpriteExtra(
+		ButtonSprite::create("Move"),
+		[this](CCMenuItemSpriteExtra* sender) { transfer(true); }
+	);
+	copyButton->m_baseScale = .7;
+	moveButton->m_baseScale = .7;
+	copyButton->setScale(.7);
+	moveButton->setScale(.7);
+
+	m_mainLayer->addChildAtPosition(
+		m_layerLabel, geode::Anchor::Center, ccp(0, 5)
+	);
+	m_buttonMenu->addChildAtPosition(
+		previousLayerBtn, geode::Anchor::Left, ccp(20, 5)
+	);
+	m_buttonMenu->addChildAtPosition(
+		nextLayerBtn, geode::Anchor::Right, ccp(-20, 5)
+	);
+	m_buttonMenu->addChildAtPosition(
+		copyButton, geode::Anchor::Bottom, ccp(-45, 25)
+	);
+	m_buttonMenu->addChildAtPosition(
+		moveButton, geode::Anchor::Bottom, ccp(45, 25)
+	);
+
+	return true;
+}
+
+// Goes through every layer and the one after the last, skipping the current
+// layer
+void CheckpointTransferPopup::switchTargetLayer(bool forward) {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer == nullptr)
+		return;
+
+	unsigned int activeLayer = playLayer->m_fields->m_activeSaveLayer;
+	unsigned int layerCount = playLayer->m_fields->m_saveLayerCount;
+
+	for (unsigned int i = 0; i <= layerCount; i++) {
+		if (forward)
+			m_targetLayer = m_targetLayer >= layerCount ? 0 : m_targetLayer + 1;
+		else
+			m_targetLayer = m_targetLayer == 0 ? layerCount : m_targetLayer - 1;
+
+		if (m_targetLayer != activeLayer)
+			break;
+	}
+
+	updateLayerLabel();
+}
+
+void CheckpointTransferPopup::updateLayerLabel() {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer == nullptr)
+		return;
+
+	unsigned int layerCount = playLayer->m_fields->m_saveLayerCount;
+	if (m_targetLayer >= layerCount)
+		m_layerLabel->setString("New Layer");
+	else
+		m_layerLabel->setString(
+			fmt::format("Layer: {}/{}", m_targetLayer + 1, layerCount).c_str()
+		);
+}
+
+void CheckpointTransferPopup::transfer(bool move) {
+	ModPlayLayer* playLayer = static_cast<ModPlayLayer*>(PlayLayer::get());
+	if (playLayer == nullptr)
+		return;
+
+	if (!playLayer->copyCheckpointToSaveLayer(m_checkpoint, m_targetLayer)) {
+		FLAlertLayer::create(
+			"Can't copy",
+			"The checkpoints of that layer were saved in another version of "
+			"the mod, platform or level version.",
+			"Ok"
+		)
+			->show();
+		return;
+	}
+
+	if (move)
+		playLayer->removePersistentCheckpoint(m_checkpoint);
+
+	if (m_onTransfer)
+		m_onTransfer();
+
+	onClose(nullptr);
+}
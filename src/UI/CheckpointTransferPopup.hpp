@@ -0,0 +1,27 @@
+#pragma once
+#include "../PersistentCheckpoint.hpp"
+
+#include <functional>
+
+using namespace geode::prelude;
+
+// Copies or moves a checkpoint of the current layer to another layer
+class CheckpointTransferPopup
+	: public Popup<PersistentCheckpoint*, std::function<void()>> {
+public:
+	bool setup(
+		PersistentCheckpoint* checkpoint, std::function<void()> onTransfer
+	) override;
+	static CheckpointTransferPopup*
+	create(PersistentCheckpoint* checkpoint, std::function<void()> onTransfer);
+
+private:
+	Ref<PersistentCheckpoint> m_checkpoint = nullptr;
+	std::function<void()> m_onTransfer;
+	unsigned int m_targetLayer = 0;
+	CCLabelBMFont* m_layerLabel = nullptr;
+
+	void switchTargetLayer(bool forward);
+	void updateLayerLabel();
+	void transfer(bool move);
+};
@@ -1,3 +1,5 @@
+#include "Save/SaveWriter.hpp"
+
 #include <Geode/Geode.hpp>
 #ifndef GEODE_IS_IOS
 #include <geode.custom-keybinds/include/Keybinds.hpp>
@@ -69,3 +71,7 @@ $execute {
 	);
 #endif
 }
+
+// Checkpoints are written in the background, make sure they are on disk
+// before the game closes
+$on_mod(DataSaved) { SaveWriter::get()->flush(); }